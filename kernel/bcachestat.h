@@ -0,0 +1,9 @@
+// Buffer cache statistics, returned by bcachestat().
+struct bcachestat {
+  int nbuf;        // Buffers in the cache
+  int limit;       // Most buffers the cache may grow to
+  uint64 nhit;     // Lookups that found the block cached
+  uint64 nmiss;    // Lookups that had to read the block
+  uint64 nprefetch; // Blocks read ahead of use
+  uint64 nreclaim; // Pages of buffers given back under memory pressure
+};
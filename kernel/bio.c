@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -8,12 +8,13 @@
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
 // * After changing buffer data, call bwrite to write it to disk.
+// * To have several reads or writes in flight at once, start
+//     each with bread_async or bwrite_async, then bwait for each.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
 
-
 #include "types.h"
 #include "param.h"
 #include "spinlock.h"
@@ -22,132 +23,505 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "bcachestat.h"
+
+#define NBUCKET 61
+
+// A page of buffers allocated with kalloc(), beyond the NBUF
+// static ones.
+struct bpage {
+  struct bpage *next;
+  struct buf buf[];
+};
+
+#define BUFPERPAGE ((int)((PGSIZE - sizeof(struct bpage)) / sizeof(struct buf)))
 
+// Each buffer is in the bucket for its (dev, blockno), so
+// lookups of different blocks mostly take different locks.
+// Instead of a global LRU list, brelse() stamps each buffer
+// with the time it became unused, and bget() evicts the
+// unused buffer with the oldest stamp.
+//
+// The cache starts with NBUF buffers and, while there are
+// fewer than limit, grows by a page of buffers on a miss
+// instead of evicting. breclaim() gives pages back when
+// kalloc() runs out of memory, down to min buffers.
 struct {
-  struct spinlock lock;
+  struct spinlock lock;   // serializes eviction, growth, reclaim
   struct buf buf[NBUF];
+  struct buf *free;       // buffers holding no block
+  struct bpage *pages;    // kalloc'd pages of buffers
+  int nbuf;               // static and kalloc'd buffers
+  int limit;              // max nbuf
+  int min;                // nbuf breclaim() leaves; see bcachemin()
+
+  struct {
+    struct spinlock lock;
+    struct buf *head;     // chain through buf.next
+  } bucket[NBUCKET];
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  uint64 nhit;            // bget() found the block cached
+  uint64 nmiss;           // bget() had to recycle a buffer
+  uint64 nprefetch;       // bprefetch() started a read
+  uint64 nreclaim;        // pages given back to kalloc()
 } bcache;
 
+static int
+bhash(uint dev, uint blockno)
+{
+  return (dev * 31 + blockno) % NBUCKET;
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  int i;
 
   initlock(&bcache.lock, "bcache");
+  for(i = 0; i < NBUCKET; i++)
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->next = bcache.free;
+    bcache.free = b;
   }
+  bcache.nbuf = NBUF;
+  bcache.limit = BUFLIMIT;
+  bcache.min = NBUF;
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
-static struct buf*
-bget(uint dev, uint blockno)
+// Add a page of buffers to the free list, if there is memory
+// for one. Called without any bcache lock held, since
+// kalloc() may call breclaim().
+static void
+bgrow(void)
 {
+  struct bpage *pg;
   struct buf *b;
 
+  if((pg = (struct bpage*)kalloc()) == 0)
+    return;
+  memset(pg, 0, PGSIZE);
+  for(b = pg->buf; b < pg->buf+BUFPERPAGE; b++)
+    initsleeplock(&b->lock, "buffer");
+
   acquire(&bcache.lock);
+  if(bcache.nbuf + BUFPERPAGE > bcache.limit){
+    // someone else grew it meanwhile.
+    release(&bcache.lock);
+    kfree(pg);
+    return;
+  }
+  pg->next = bcache.pages;
+  bcache.pages = pg;
+  for(b = pg->buf; b < pg->buf+BUFPERPAGE; b++){
+    b->next = bcache.free;
+    bcache.free = b;
+  }
+  bcache.nbuf += BUFPERPAGE;
+  release(&bcache.lock);
+}
 
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+// Find block (dev, blockno) in bucket h and take a reference.
+// Caller must hold bucket h's lock.
+static struct buf*
+bfind(int h, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bcache.bucket[h].head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
       return b;
     }
   }
+  return 0;
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return locked buffer.
+// For a prefetch, return 0 instead if the block is already
+// cached, or if every buffer is in use.
+static struct buf*
+bget(uint dev, uint blockno, int prefetch)
+{
+  struct buf *b, *victim, **pp, **victimpp;
+  int h = bhash(dev, blockno);
+  int i, vh;
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
+  acquire(&bcache.bucket[h].lock);
+
+  // Is the block already cached?
+  if((b = bfind(h, dev, blockno)) != 0){
+    if(prefetch){
+      b->refcnt--;
+      release(&bcache.bucket[h].lock);
+      return 0;
+    }
+    release(&bcache.bucket[h].lock);
+    __sync_fetch_and_add(&bcache.nhit, 1);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  release(&bcache.bucket[h].lock);
+
+  // Not cached. Rather than evict a block that may be wanted
+  // again, grow the cache if it is allowed to. The unlocked
+  // check is only a hint.
+  if(bcache.free == 0 && bcache.nbuf + BUFPERPAGE <= bcache.limit)
+    bgrow();
+
+  // Only one process at a time evicts, so that two can't both
+  // cache the same block, and so that holding two bucket locks
+  // can't deadlock.
+  acquire(&bcache.lock);
+
+  // Someone may have cached it while we didn't hold a lock.
+  acquire(&bcache.bucket[h].lock);
+  if((b = bfind(h, dev, blockno)) != 0){
+    if(prefetch)
+      b->refcnt--;
+    release(&bcache.bucket[h].lock);
+    release(&bcache.lock);
+    if(prefetch)
+      return 0;
+    __sync_fetch_and_add(&bcache.nhit, 1);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  release(&bcache.bucket[h].lock);
+
+  if((victim = bcache.free) != 0){
+    bcache.free = victim->next;
+    acquire(&bcache.bucket[h].lock);
+  } else {
+    // Recycle the least recently used unused buffer, holding
+    // the lock of the bucket it is in until it has moved.
+    victimpp = 0;
+    vh = -1;
+    for(i = 0; i < NBUCKET; i++){
+      int found = 0;
+      acquire(&bcache.bucket[i].lock);
+      for(pp = &bcache.bucket[i].head; (b = *pp) != 0; pp = &b->next){
+        if(b->refcnt == 0 && (victim == 0 || b->lastuse < victim->lastuse)){
+          victim = b;
+          victimpp = pp;
+          found = 1;
+        }
+      }
+      if(found){
+        if(vh >= 0)
+          release(&bcache.bucket[vh].lock);
+        vh = i;
+      } else {
+        release(&bcache.bucket[i].lock);
+      }
+    }
+    if(victim == 0 && prefetch){
       release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+      return 0;
+    }
+    if(victim == 0)
+      panic("bget: no buffers");
+
+    // move it to bucket h.
+    *victimpp = victim->next;
+    if(vh != h){
+      release(&bcache.bucket[vh].lock);
+      acquire(&bcache.bucket[h].lock);
     }
   }
-  panic("bget: no buffers");
+  victim->dev = dev;
+  victim->blockno = blockno;
+  victim->valid = 0;
+  victim->refcnt = 1;
+  victim->next = bcache.bucket[h].head;
+  bcache.bucket[h].head = victim;
+  release(&bcache.bucket[h].lock);
+  release(&bcache.lock);
+
+  if(prefetch)
+    __sync_fetch_and_add(&bcache.nprefetch, 1);
+  else
+    __sync_fetch_and_add(&bcache.nmiss, 1);
+  acquiresleep(&victim->lock);
+  return victim;
 }
 
-// Return a locked buf with the contents of the indicated block.
+// Take unused buffer b out of its bucket, or the free list.
+// Caller must hold bcache.lock and every bucket lock.
+static void
+bunlink(struct buf *b)
+{
+  struct buf **pp;
+
+  pp = &bcache.bucket[bhash(b->dev, b->blockno)].head;
+  while(*pp && *pp != b)
+    pp = &(*pp)->next;
+  if(*pp == 0){
+    pp = &bcache.free;
+    while(*pp != b)
+      pp = &(*pp)->next;
+  }
+  *pp = b->next;
+}
+
+// Give kalloc() back the page of buffers that has gone unused
+// longest, for when memory runs out. Buffers that aren't in
+// use are clean: the log pins the ones it has yet to write.
+// Returns 1 if a page was freed, 0 if every page is in use.
+int
+breclaim(void)
+{
+  struct bpage *pg, **pp, **victimpp;
+  uint last, victimlast;
+  int i;
+
+  acquire(&bcache.lock);
+  for(i = 0; i < NBUCKET; i++)
+    acquire(&bcache.bucket[i].lock);
+
+  victimpp = 0;
+  victimlast = 0;
+  for(pp = &bcache.pages; (pg = *pp) != 0; pp = &pg->next){
+    last = 0;
+    for(i = 0; i < BUFPERPAGE; i++){
+      if(pg->buf[i].refcnt != 0)
+        break;
+      if(pg->buf[i].lastuse > last)
+        last = pg->buf[i].lastuse;
+    }
+    if(i == BUFPERPAGE && (victimpp == 0 || last < victimlast)){
+      victimpp = pp;
+      victimlast = last;
+    }
+  }
+
+  pg = 0;
+  if(victimpp && bcache.nbuf - BUFPERPAGE >= bcache.min){
+    pg = *victimpp;
+    *victimpp = pg->next;
+    for(i = 0; i < BUFPERPAGE; i++)
+      bunlink(&pg->buf[i]);
+    bcache.nbuf -= BUFPERPAGE;
+    bcache.nreclaim++;
+  }
+
+  for(i = NBUCKET-1; i >= 0; i--)
+    release(&bcache.bucket[i].lock);
+  release(&bcache.lock);
+
+  if(pg == 0)
+    return 0;
+  kfree(pg);
+  return 1;
+}
+
+// Set the most buffers the cache may grow to, giving back
+// pages beyond that if they are unused.
+int
+bcachelimit(int limit)
+{
+  if(limit < bcache.min)
+    return -1;
+  bcache.limit = limit;
+  while(bcache.nbuf > limit && breclaim())
+    ;
+  return 0;
+}
+
+// Grow the cache to at least n buffers, and keep it that
+// big, for a log that may pin that many.
+void
+bcachemin(int n)
+{
+  int nbuf;
+
+  bcache.min = n;
+  if(bcache.limit < n + BUFPERPAGE)
+    bcache.limit = n + BUFPERPAGE;
+  while(1){
+    acquire(&bcache.lock);
+    nbuf = bcache.nbuf;
+    release(&bcache.lock);
+    if(nbuf >= n)
+      break;
+    bgrow();
+    acquire(&bcache.lock);
+    if(bcache.nbuf == nbuf)
+      panic("bcachemin");
+    release(&bcache.lock);
+  }
+}
+
+// Return a locked buf for the indicated block, having
+// started to read its contents if they aren't cached.
+// Call bwait() before looking at b->data.
 struct buf*
-bread(uint dev, uint blockno)
+bread_async(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
+  b = bget(dev, blockno, 0);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
-    b->valid = 1;
+    b->iodone = 0;
+    virtio_disk_submit(b, 0);
   }
   return b;
 }
 
+// Return a locked buf with the contents of the indicated block.
+struct buf*
+bread(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bread_async(dev, blockno);
+  bwait(b);
+  return b;
+}
+
+// Finish a read started by bprefetch(). Called by the disk
+// driver, from its interrupt handler.
+static void
+bdone(struct buf *b)
+{
+  int h = bhash(b->dev, b->blockno);
+
+  b->valid = 1;
+  releasesleep(&b->lock);
+
+  acquire(&bcache.bucket[h].lock);
+  b->refcnt--;
+  if(b->refcnt == 0)
+    b->lastuse = ticks;
+  release(&bcache.bucket[h].lock);
+}
+
+// Start reading block (dev, blockno) into the cache, unless
+// it is there already, and return without waiting for the
+// disk. The buffer stays locked until the read is done, so a
+// bread() of the block in the meantime waits for it.
+void
+bprefetch(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bget(dev, blockno, 1)) == 0)
+    return;
+  // bdone() releases the lock, in an interrupt.
+  disownsleep(&b->lock);
+  b->iodone = bdone;
+  virtio_disk_submit(b, 0);
+}
+
+// Start writing b's contents to disk.  Must be locked, and
+// stay locked until bwait() returns.
+void
+bwrite_async(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwrite_async");
+  b->iodone = 0;
+  virtio_disk_submit(b, 1);
+}
+
+// Wait for the read or write of b started by bread_async()
+// or bwrite_async(), if any.
+void
+bwait(struct buf *b)
+{
+  virtio_disk_wait(b);
+  b->valid = 1;
+}
+
+// Start reading or writing b, a buf of the caller's own that
+// isn't in the cache, at block (dev, blockno). Wait for it
+// with bwait().
+void
+bstart(struct buf *b, uint dev, uint blockno, int write)
+{
+  b->dev = dev;
+  b->blockno = blockno;
+  b->iodone = 0;
+  virtio_disk_submit(b, write);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  bwrite_async(b);
+  bwait(b);
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// If no one else is using it, note when, for bget()'s LRU.
 void
 brelse(struct buf *b)
 {
+  int h;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  h = bhash(b->dev, b->blockno);
+  acquire(&bcache.bucket[h].lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->lastuse = ticks;
   }
-  
-  release(&bcache.lock);
+  release(&bcache.bucket[h].lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int h = bhash(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[h].lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bcache.bucket[h].lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  int h = bhash(b->dev, b->blockno);
+
+  acquire(&bcache.bucket[h].lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bcache.bucket[h].lock);
 }
 
+// Copy the cache's size and counters to user address addr,
+// a struct bcachestat, and then clear the counters if reset
+// is set.
+int
+bcachestat(uint64 addr, int reset)
+{
+  struct bcachestat st;
 
+  memset(&st, 0, sizeof(st));
+  st.nbuf = bcache.nbuf;
+  st.limit = bcache.limit;
+  st.nhit = bcache.nhit;
+  st.nmiss = bcache.nmiss;
+  st.nprefetch = bcache.nprefetch;
+  st.nreclaim = bcache.nreclaim;
+  if(either_copyout(1, addr, &st, sizeof(st)) < 0)
+    return -1;
+  if(reset){
+    bcache.nhit = 0;
+    bcache.nmiss = 0;
+    bcache.nprefetch = 0;
+    bcache.nreclaim = 0;
+  }
+  return 0;
+}
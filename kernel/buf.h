@@ -1,12 +1,15 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  void (*iodone)(struct buf*); // called when an I/O finishes, if set
+  int iowrite;       // is the disk's I/O on buf a write?
+  struct buf *qnext; // disk queue, or request, chain
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint lastuse;     // ticks when refcnt last fell to 0, for LRU
+  struct buf *next; // hash bucket chain
   uchar data[BSIZE];
 };
 
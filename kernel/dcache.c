@@ -0,0 +1,290 @@
+//
+// Directory entry cache: remembers which inode number each
+// (device, directory inode number, name) looked up by namex()
+// or linked by dirlink() refers to, or that it is absent (a
+// negative entry, with inum 0), so that later lookups of the
+// same path can run without locking any inode.
+//
+// Lookups walk the hash chains with no lock, inside an RCU
+// read-side section. Insertions and removals take dcache.lock,
+// and a removed entry is only reused after a grace period (see
+// call_rcu()), since a lookup may still be looking at it. An
+// entry doesn't change while it is in the table, except that
+// isdir may get set.
+//
+// Every removal that could leave a lookup holding a stale
+// inode number (unlink, or an inode being freed) bumps
+// dcache.seq; see namefast() in fs.c.
+//
+// Lookups are counted per CPU, so that counting doesn't
+// share a cache line between CPUs.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "dcachestat.h"
+
+#define NDHASH 61
+
+struct dentry {
+  struct rcuhead rcu;    // must be first; see freedentry()
+  struct dentry *next;   // hash chain, or free list
+  int inuse;             // in a hash chain?
+  uint dev;
+  uint dir;              // inum of the directory
+  uint inum;             // inum that name refers to, or 0
+  int isdir;             // inum is known to be a directory
+  char name[DIRSIZ];
+};
+
+struct {
+  struct spinlock lock;
+  uint seq;                        // bumped by removals
+  struct dentry *hash[NDHASH];
+  struct dentry *free;             // entries ready for reuse
+  int hand;                        // next entry to consider evicting
+  struct dentry dentry[NDENTRY];
+} dcache;
+
+struct dcount {
+  uint64 nhit;
+  uint64 nneg;
+  uint64 nmiss;
+};
+
+static struct dcount dcount[NCPU];
+
+void
+dcacheinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  for(d = dcache.dentry; d < &dcache.dentry[NDENTRY]; d++){
+    d->next = dcache.free;
+    dcache.free = d;
+  }
+}
+
+static uint
+dhash(uint dev, uint dir, char *name)
+{
+  uint h = dev * 31 + dir;
+
+  for(int i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h % NDHASH;
+}
+
+static int
+dmatch(struct dentry *d, uint dev, uint dir, char *name)
+{
+  return d->dev == dev && d->dir == dir && namecmp(d->name, name) == 0;
+}
+
+// Return d to the free list, a grace period after it
+// left its hash chain.
+static void
+freedentry(struct rcuhead *head)
+{
+  struct dentry *d = (struct dentry*)head;
+
+  acquire(&dcache.lock);
+  d->next = dcache.free;
+  dcache.free = d;
+  release(&dcache.lock);
+}
+
+// Take d, which pp points to, out of its hash chain. d->next
+// is left alone, for lookups that are still walking past d.
+// Caller must hold dcache.lock.
+static void
+dunlink(struct dentry **pp, struct dentry *d)
+{
+  *pp = d->next;
+  d->inuse = 0;
+  call_rcu(&d->rcu, freedentry);
+}
+
+// Look up name in directory dir on dev. If the entry is
+// cached, returns 1 and sets *inum to the inum it refers to,
+// or 0 if name is absent, and *isdir if that is known to be
+// a directory. Returns 0 if the entry isn't cached.
+// Caller must be in an RCU read-side section.
+int
+dcache_lookup(uint dev, uint dir, char *name, uint *inum, int *isdir)
+{
+  struct dentry *d;
+  struct dcount *c = &dcount[cpuid()];
+
+  for(d = dcache.hash[dhash(dev, dir, name)]; d; d = d->next){
+    if(dmatch(d, dev, dir, name)){
+      *inum = d->inum;
+      *isdir = d->isdir;
+      if(d->inum)
+        c->nhit++;
+      else
+        c->nneg++;
+      return 1;
+    }
+  }
+  c->nmiss++;
+  return 0;
+}
+
+// Cache name in directory dir on dev as referring to inum,
+// or as absent if inum is 0, replacing any other entry for
+// it. Caller must hold dcache.lock.
+static void
+dput(uint dev, uint dir, char *name, uint inum)
+{
+  struct dentry *d, **pp;
+  uint h = dhash(dev, dir, name);
+  int i;
+
+  for(pp = &dcache.hash[h]; (d = *pp) != 0; pp = &d->next){
+    if(dmatch(d, dev, dir, name)){
+      if(d->inum == inum)
+        return;
+      dunlink(pp, d);
+      break;
+    }
+  }
+
+  if((d = dcache.free) == 0){
+    // evict some other entry, to be reusable after a grace
+    // period, and skip caching this one.
+    for(i = 0; i < NDENTRY; i++){
+      d = &dcache.dentry[dcache.hand];
+      dcache.hand = (dcache.hand + 1) % NDENTRY;
+      if(!d->inuse)
+        continue;
+      pp = &dcache.hash[dhash(d->dev, d->dir, d->name)];
+      while(*pp != d)
+        pp = &(*pp)->next;
+      dunlink(pp, d);
+      break;
+    }
+    return;
+  }
+  dcache.free = d->next;
+
+  d->dev = dev;
+  d->dir = dir;
+  d->inum = inum;
+  d->isdir = 0;
+  strncpy(d->name, name, DIRSIZ);
+  d->inuse = 1;
+  d->next = dcache.hash[h];
+  // lookups may find d as soon as it is linked.
+  __sync_synchronize();
+  dcache.hash[h] = d;
+}
+
+// Remember that name in directory dir on dev refers to inum,
+// or is absent if inum is 0. Caller must hold dir's inode
+// lock, perhaps shared, so the directory entry can't be
+// added or removed meanwhile.
+void
+dcache_insert(uint dev, uint dir, char *name, uint inum)
+{
+  acquire(&dcache.lock);
+  dput(dev, dir, name, inum);
+  release(&dcache.lock);
+}
+
+// Note that the entry for name in dir, if it still refers
+// to inum, refers to a directory.
+void
+dcache_setdir(uint dev, uint dir, char *name, uint inum)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.hash[dhash(dev, dir, name)]; d; d = d->next){
+    if(dmatch(d, dev, dir, name)){
+      if(d->inum == inum)
+        d->isdir = 1;
+      break;
+    }
+  }
+  release(&dcache.lock);
+}
+
+// Note that name in directory dir, which is being unlinked,
+// is absent. Caller must hold dir's inode lock.
+void
+dcache_remove(uint dev, uint dir, char *name)
+{
+  acquire(&dcache.lock);
+  dcache.seq++;
+  dput(dev, dir, name, 0);
+  release(&dcache.lock);
+}
+
+// Forget every entry in, or referring to, inode inum on dev,
+// which is being freed.
+void
+dcache_purge(uint dev, uint inum)
+{
+  struct dentry *d, **pp;
+  int h;
+
+  acquire(&dcache.lock);
+  dcache.seq++;
+  for(h = 0; h < NDHASH; h++){
+    pp = &dcache.hash[h];
+    while((d = *pp) != 0){
+      if(d->dev == dev && (d->dir == inum || d->inum == inum))
+        dunlink(pp, d);
+      else
+        pp = &d->next;
+    }
+  }
+  release(&dcache.lock);
+}
+
+// Return the removal count, for a lookup to compare before
+// and after.
+uint
+dcache_seq(void)
+{
+  __sync_synchronize();
+  return dcache.seq;
+}
+
+// Copy the cache's statistics to user address addr, a struct
+// dcachestat, and then clear the counters if reset is set.
+int
+dcachestat(uint64 addr, int reset)
+{
+  struct dcachestat st;
+  struct dentry *d;
+  int id;
+
+  memset(&st, 0, sizeof(st));
+  acquire(&dcache.lock);
+  for(d = dcache.dentry; d < &dcache.dentry[NDENTRY]; d++){
+    if(d->inuse){
+      st.nentry++;
+      if(d->inum == 0)
+        st.nnegentry++;
+    }
+  }
+  release(&dcache.lock);
+  for(id = 0; id < NCPU; id++){
+    st.nhit += dcount[id].nhit;
+    st.nneg += dcount[id].nneg;
+    st.nmiss += dcount[id].nmiss;
+  }
+  if(either_copyout(1, addr, &st, sizeof(st)) < 0)
+    return -1;
+  if(reset)
+    memset(dcount, 0, sizeof(dcount));
+  return 0;
+}
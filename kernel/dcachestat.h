@@ -0,0 +1,8 @@
+// Directory entry cache statistics, returned by dcachestat().
+struct dcachestat {
+  int nentry;      // Entries in the cache
+  int nnegentry;   // Of those, names cached as absent
+  uint64 nhit;     // Lookups that found the name's inode
+  uint64 nneg;     // Lookups that found the name absent
+  uint64 nmiss;    // Lookups that found nothing cached
+};
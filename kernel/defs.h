@@ -4,6 +4,7 @@ struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct rcuhead;
 struct spinlock;
 struct sleeplock;
 struct stat;
@@ -12,19 +13,43 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bread_async(uint, uint);
+void            bwrite_async(struct buf*);
+void            bwait(struct buf*);
+void            bstart(struct buf*, uint, uint, int);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bcachestat(uint64, int);
+int             bcachelimit(int);
+void            bcachemin(int);
+int             breclaim(void);
+void            bprefetch(uint, uint);
 
 // console.c
 void            consoleinit(void);
 void            consoleintr(int);
 void            consputc(int);
 
+// dcache.c
+void            dcacheinit(void);
+int             dcache_lookup(uint, uint, char*, uint*, int*);
+void            dcache_insert(uint, uint, char*, uint);
+void            dcache_setdir(uint, uint, char*, uint);
+void            dcache_remove(uint, uint, char*);
+void            dcache_purge(uint, uint);
+uint            dcache_seq(void);
+int             dcachestat(uint64, int);
+
 // exec.c
 int             exec(char*, char**);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint64, int);
+int             futexwake(uint64, int);
+
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
@@ -41,15 +66,19 @@ struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit();
+int             ireclaim(void);
 void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
+void            ilock_shared(struct inode*);
+void            iunlock_shared(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+void            iprefetch(struct inode*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
@@ -63,10 +92,10 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
-uint8           add_ref(uint64, int);
-uint8           get_ref(uint64);
-uint8           increment_ref(uint64);
-uint8           decrement_ref(uint64);
+uint16          add_ref(uint64, int);
+uint16          get_ref(uint64);
+uint16          increment_ref(uint64);
+uint16          decrement_ref(uint64);
 void*           cow_copy_page(uint64);
 
 // log.c
@@ -74,6 +103,14 @@ void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+int             begin_opn(int);
+void            end_opn(int);
+int             logstat(uint64, int);
+int             log_inplace(struct buf*);
+void            log_free(uint);
+int             logmode(int);
+int             logsize(int);
+void            log_sync(void);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
@@ -88,6 +125,7 @@ void            printfinit(void);
 
 // proc.c
 int             cpuid(void);
+void            kthread(char*, void (*)(void));
 void            exit(int);
 int             fork(void);
 int             growproc(int);
@@ -102,10 +140,18 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+void            sleep_handoff(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+void            wakeup_handoff(void*);
+int             wakeupn(void*, int);
 void            yield(void);
+int             setaffinity(int);
+int             schedstat(int, uint64);
+void            rcu_read_lock(void);
+void            rcu_read_unlock(void);
+void            call_rcu(struct rcuhead*, void (*)(struct rcuhead*));
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -118,14 +164,21 @@ void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
+int             tryacquire(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+int             lockstat(uint64, int, int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
+void            acquiresleep_shared(struct sleeplock*);
+void            releasesleep_shared(struct sleeplock*);
+void            downgradesleep(struct sleeplock*);
+int             holdingsleep_shared(struct sleeplock*);
+void            disownsleep(struct sleeplock*);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -163,6 +216,9 @@ void            kvminit(void);
 void            kvminithart(void);
 uint64          kvmpa(uint64);
 void            kvmmap(uint64, uint64, uint64, int);
+void            kvmreserve(uint64, uint64);
+int             kvmmapstack(uint64);
+void            kvmunmapstack(uint64);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
@@ -173,6 +229,8 @@ void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
 uint64          walkaddr(pagetable_t, uint64);
+uint64          walkaddrw(pagetable_t, uint64);
+int             uvmshare(pagetable_t, uint64, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
@@ -186,8 +244,10 @@ void            plic_complete(int);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_submit(struct buf *, int);
+void            virtio_disk_wait(struct buf *);
 void            virtio_disk_intr(void);
+int             virtio_disk_stat(uint64, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -0,0 +1,7 @@
+// Disk request statistics, returned by diskstat().
+struct diskstat {
+  uint64 nreq;     // Requests sent to the disk
+  uint64 nblock;   // Blocks they read or wrote
+  uint64 nwrite;   // Requests that wrote
+  uint ticks;      // Ticks since the counters were reset
+};
@@ -13,6 +13,9 @@
 #include "stat.h"
 #include "proc.h"
 
+#define RAMIN 4   // first read-ahead window, in blocks
+#define RAMAX 32  // largest read-ahead window
+
 struct devsw devsw[NDEV];
 struct {
   struct spinlock lock;
@@ -91,9 +94,9 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilock_shared(f->ip);
     stati(f->ip, &st);
-    iunlock(f->ip);
+    iunlock_shared(f->ip);
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
       return -1;
     return 0;
@@ -101,6 +104,36 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Read ahead after a read of n bytes at off from f.
+// While reads keep picking up where the last one left off,
+// keep the next f->rawin blocks on their way into the buffer
+// cache, and double the window each time the reader gets
+// through half of it. Any other read resets the window.
+// Caller must hold f->ip's lock, perhaps shared.
+static void
+readahead(struct file *f, uint off, int n)
+{
+  uint next = (off + n) / BSIZE;   // first block not yet read
+
+  if(off != f->rapos){
+    f->rawin = 0;
+    f->ranext = next;
+  }
+  f->rapos = off + n;
+  if(f->ranext < next)
+    f->ranext = next;
+
+  if(f->rawin == 0)
+    f->rawin = RAMIN;
+  else if(f->ranext - next > f->rawin / 2)
+    return;
+  else if(f->rawin < RAMAX)
+    f->rawin *= 2;
+
+  iprefetch(f->ip, f->ranext, next + f->rawin - f->ranext);
+  f->ranext = next + f->rawin;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
@@ -117,10 +150,22 @@ fileread(struct file *f, uint64 addr, int n)
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
     r = devsw[f->major].read(1, addr, n);
+  } else if(f->type == FD_INODE && f->ref == 1){
+    // no other process shares f->off, and none can start to
+    // while we are in here, so a shared lock will do.
+    ilock_shared(f->ip);
+    if((r = readi(f->ip, 1, addr, f->off, n)) > 0){
+      readahead(f, f->off, r);
+      f->off += r;
+    }
+    iunlock_shared(f->ip);
   } else if(f->type == FD_INODE){
+    // the exclusive lock also serializes updates of f->off.
     ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+    if((r = readi(f->ip, 1, addr, f->off, n)) > 0){
+      readahead(f, f->off, r);
       f->off += r;
+    }
     iunlock(f->ip);
   } else {
     panic("fileread");
@@ -146,25 +191,25 @@ filewrite(struct file *f, uint64 addr, int n)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
+    // write as many blocks at a time as this op's share
+    // of the log allows, counting an allocation block for
+    // each, the i-node, an indirect block, and 2 blocks of
+    // slop for non-aligned writes.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
     int i = 0;
     while(i < n){
       int n1 = n - i;
+      int nlog = begin_opn(2*((n1+BSIZE-1)/BSIZE) + 1+1+2);
+      int max = ((nlog-1-1-2) / 2) * BSIZE;
       if(n1 > max)
         n1 = max;
 
-      begin_op();
       ilock(f->ip);
       if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
         f->off += r;
       iunlock(f->ip);
-      end_op();
+      end_opn(nlog);
 
       if(r < 0)
         break;
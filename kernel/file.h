@@ -6,6 +6,9 @@ struct file {
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
+  uint rapos;        // FD_INODE: where a sequential read would start
+  uint ranext;       // FD_INODE: first block not yet read ahead
+  uint rawin;        // FD_INODE: read-ahead window, in blocks
   short major;       // FD_DEVICE
 };
 
@@ -18,6 +21,8 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *next; // hash chain, or free list
+  struct inode *lprev, *lnext; // LRU list of unused inodes
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -26,7 +31,11 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  short flags;
+  union {
+    uint addrs[NDIRECT+NLEVEL];
+    char data[NINLINE];
+  };
 };
 
 // map major device number to device functions.
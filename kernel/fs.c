@@ -22,10 +22,37 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+#define NINPLACE 8  // in-place data writes writei() keeps in flight
+#define AGSIZE 1024 // blocks per allocation group, at least
+#define NAG 64      // most allocation groups
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
 
+// Allocation state, kept in memory from mount time; see
+// allocinit(). The blocks are divided into allocation groups,
+// each with a count of its free blocks and a hint of where
+// to look for the next one, which moves on past each block
+// allocated. A search for a block with no goal starts in a
+// group picked by the CPU, and inode searches start at a
+// hint of the CPU's own, so that CPUs allocating at once
+// mostly look at different bitmap bits and inode blocks.
+struct {
+  uint size;    // blocks per group
+  int n;        // groups
+  struct {
+    struct spinlock lock;
+    int nfree;  // free blocks
+    uint hint;  // block to look at first
+  } group[NAG];
+
+  struct spinlock ilock;
+  int nifree;         // free inodes
+  uint ihint[NCPU];   // inum to look at first, per CPU
+} alloc;
+
+static void allocinit(int);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -44,6 +71,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  allocinit(dev);
 }
 
 // Zero a block.
@@ -60,27 +88,132 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+static int
+mycpuid(void)
+{
+  int id;
+
+  push_off();
+  id = cpuid();
+  pop_off();
+  return id;
+}
+
+// Count the free blocks in each allocation group, and the
+// free inodes, after recovery has made the disk consistent.
+static void
+allocinit(int dev)
+{
+  struct buf *bp;
+  struct dinode *dip;
+  uint b, inum;
+  int g, id;
+
+  alloc.size = AGSIZE;
+  while((sb.size + alloc.size - 1) / alloc.size > NAG)
+    alloc.size *= 2;
+  alloc.n = (sb.size + alloc.size - 1) / alloc.size;
+
+  bp = 0;
+  for(g = 0; g < alloc.n; g++){
+    initlock(&alloc.group[g].lock, "agroup");
+    alloc.group[g].hint = g * alloc.size;
+    for(b = g * alloc.size; b < (g+1) * alloc.size && b < sb.size; b++){
+      if(bp == 0 || bp->blockno != BBLOCK(b, sb)){
+        if(bp)
+          brelse(bp);
+        bp = bread(dev, BBLOCK(b, sb));
+      }
+      if((bp->data[(b % BPB)/8] & (1 << (b % 8))) == 0)
+        alloc.group[g].nfree++;
+    }
+  }
+  if(bp)
+    brelse(bp);
+
+  initlock(&alloc.ilock, "ialloc");
+  bp = 0;
+  for(inum = 1; inum < sb.ninodes; inum++){
+    if(bp == 0 || bp->blockno != IBLOCK(inum, sb)){
+      if(bp)
+        brelse(bp);
+      bp = bread(dev, IBLOCK(inum, sb));
+    }
+    dip = (struct dinode*)bp->data + inum%IPB;
+    if(dip->type == 0)
+      alloc.nifree++;
+  }
+  if(bp)
+    brelse(bp);
+  for(id = 0; id < NCPU; id++)
+    alloc.ihint[id] = 1 + id * (sb.ninodes - 1) / NCPU;
+}
+
+// Allocate a block in allocation group g, looking first at
+// goal, if it is in g, and else at g's hint. Returns 0 if g
+// is full.
 static uint
-balloc(uint dev)
+agalloc(uint dev, int g, uint goal)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint lo, hi, b, n;
+  int m;
+
+  lo = g * alloc.size;
+  hi = min(lo + alloc.size, sb.size);
+  acquire(&alloc.group[g].lock);
+  if(alloc.group[g].nfree == 0){
+    release(&alloc.group[g].lock);
+    return 0;
+  }
+  if(goal < lo || goal >= hi)
+    goal = alloc.group[g].hint;
+  release(&alloc.group[g].lock);
 
   bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
+  for(n = 0; n < hi - lo; n++){
+    b = goal + n;
+    if(b >= hi)
+      b -= hi - lo;
+    if(bp == 0 || bp->blockno != BBLOCK(b, sb)){
+      if(bp)
         brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+      bp = bread(dev, BBLOCK(b, sb));
+    }
+    m = 1 << (b % 8);
+    if((bp->data[(b % BPB)/8] & m) == 0){  // Is block free?
+      bp->data[(b % BPB)/8] |= m;  // Mark block in use.
+      log_write(bp);
+      acquire(&alloc.group[g].lock);
+      alloc.group[g].nfree--;
+      alloc.group[g].hint = b + 1 < hi ? b + 1 : lo;
+      release(&alloc.group[g].lock);
+      brelse(bp);
+      return b;
     }
+  }
+  if(bp)
     brelse(bp);
+  return 0;
+}
+
+// Allocate a disk block, as close after goal as there is a
+// free one, or if goal is 0 in the CPU's allocation group.
+// The caller must initialize all of it, or zero it with
+// bzero().
+static uint
+balloc(uint dev, uint goal)
+{
+  int g, start;
+  uint b;
+
+  if(goal > 0 && goal < sb.size)
+    start = goal / alloc.size;
+  else
+    start = mycpuid() % alloc.n;
+  for(g = 0; g < alloc.n; g++){
+    if((b = agalloc(dev, (start + g) % alloc.n, goal)) != 0)
+      return b;
   }
   panic("balloc: out of blocks");
 }
@@ -99,6 +232,10 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  log_free(b);
+  acquire(&alloc.group[b / alloc.size].lock);
+  alloc.group[b / alloc.size].nfree++;
+  release(&alloc.group[b / alloc.size].lock);
   brelse(bp);
 }
 
@@ -128,17 +265,18 @@ bfree(int dev, uint b)
 //   the reference and link counts have fallen to zero.
 //
 // * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
+//   is unused if ip->ref is zero. Otherwise ip->ref tracks
 //   the number of in-memory pointers to the entry (open
 //   files and current directories). iget() finds or
 //   creates a cache entry and increments its ref; iput()
-//   decrements ref.
+//   decrements ref. An unused entry stays cached until
+//   iget() recycles it for another inode.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when ip->valid is 1.
-//   ilock() reads the inode from
-//   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ilock() reads the inode from the disk and sets
+//   ip->valid, which stays set while the entry holds the
+//   inode, unless iput() frees it on disk.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -163,17 +301,40 @@ bfree(int dev, uint b)
 // multi-step atomic operations.
 //
 // The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
+// entries. Since ip->ref indicates whether an entry is in use,
 // and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// holds, one must hold icache.lock while using any of those fields,
+// or the hash and LRU links.
+//
+// The cache starts with NINODE entries, finds them by hashing
+// (dev, inum), and, while there are fewer than INODELIMIT,
+// grows by a page of entries when none is free instead of
+// recycling the least recently used unused entry.
+// ireclaim() gives pages back when kalloc() runs out of memory.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 61
+
+// A page of inodes allocated with kalloc(), beyond the
+// NINODE static ones.
+struct ipage {
+  struct ipage *next;
+  struct inode inode[];
+};
+
+#define INODEPERPAGE ((int)((PGSIZE - sizeof(struct ipage)) / sizeof(struct inode)))
+
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *hash[NIHASH]; // chains through inode.next
+  struct inode *free;         // entries holding no inode
+  struct inode lru;           // unused entries, least recently used first
+  struct ipage *pages;        // kalloc'd pages of entries
+  int ninode;                 // static and kalloc'd entries
 } icache;
 
 void
@@ -182,9 +343,117 @@ iinit()
   int i = 0;
   
   initlock(&icache.lock, "icache");
+  icache.lru.lprev = icache.lru.lnext = &icache.lru;
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&icache.inode[i].lock, "inode");
+    icache.inode[i].next = icache.free;
+    icache.free = &icache.inode[i];
   }
+  icache.ninode = NINODE;
+}
+
+static int
+ihash(uint dev, uint inum)
+{
+  return (dev * 31 + inum) % NIHASH;
+}
+
+// Caller must hold icache.lock.
+static void
+lruremove(struct inode *ip)
+{
+  ip->lprev->lnext = ip->lnext;
+  ip->lnext->lprev = ip->lprev;
+}
+
+// Take ip, which holds an inode, out of its hash chain.
+// Caller must hold icache.lock.
+static void
+iunhash(struct inode *ip)
+{
+  struct inode **pp;
+
+  pp = &icache.hash[ihash(ip->dev, ip->inum)];
+  while(*pp != ip)
+    pp = &(*pp)->next;
+  *pp = ip->next;
+}
+
+// Add a page of entries to the free list, if there is
+// memory for one. Returns 1 if it did. Called without
+// icache.lock held, since kalloc() may call ireclaim().
+static int
+igrow(void)
+{
+  struct ipage *pg;
+  struct inode *ip;
+
+  if((pg = (struct ipage*)kalloc()) == 0)
+    return 0;
+  memset(pg, 0, PGSIZE);
+  for(ip = pg->inode; ip < pg->inode+INODEPERPAGE; ip++)
+    initsleeplock(&ip->lock, "inode");
+
+  acquire(&icache.lock);
+  if(icache.ninode + INODEPERPAGE > INODELIMIT){
+    // someone else grew it meanwhile.
+    release(&icache.lock);
+    kfree(pg);
+    return 1;
+  }
+  pg->next = icache.pages;
+  icache.pages = pg;
+  for(ip = pg->inode; ip < pg->inode+INODEPERPAGE; ip++){
+    ip->next = icache.free;
+    icache.free = ip;
+  }
+  icache.ninode += INODEPERPAGE;
+  release(&icache.lock);
+  return 1;
+}
+
+// Give kalloc() back a page of entries that are all unused.
+// Cached inodes need no writing back, since the cache is
+// write-through. Returns 1 if a page was freed, 0 if every
+// page has an entry in use.
+int
+ireclaim(void)
+{
+  struct ipage *pg, **pp;
+  struct inode *ip, **fpp;
+  int i;
+
+  acquire(&icache.lock);
+  for(pp = &icache.pages; (pg = *pp) != 0; pp = &pg->next){
+    for(i = 0; i < INODEPERPAGE; i++){
+      if(pg->inode[i].ref != 0)
+        break;
+    }
+    if(i == INODEPERPAGE)
+      break;
+  }
+  if(pg){
+    *pp = pg->next;
+    for(ip = pg->inode; ip < pg->inode+INODEPERPAGE; ip++){
+      if(ip->inum == 0){
+        // on the free list.
+        fpp = &icache.free;
+        while(*fpp != ip)
+          fpp = &(*fpp)->next;
+        *fpp = ip->next;
+      } else {
+        lruremove(ip);
+        iunhash(ip);
+      }
+    }
+    icache.ninode -= INODEPERPAGE;
+  }
+  release(&icache.lock);
+
+  if(pg == 0)
+    return 0;
+  kfree(pg);
+  return 1;
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -192,25 +461,48 @@ static struct inode* iget(uint dev, uint inum);
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode.
+// Looks first at the CPU's hint, and moves it on past the
+// inode allocated.
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  uint inum, start, n;
+  int id;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
+  id = mycpuid();
+  acquire(&alloc.ilock);
+  if(alloc.nifree == 0)
+    panic("ialloc: no inodes");
+  start = alloc.ihint[id];
+  release(&alloc.ilock);
+
+  bp = 0;
+  for(n = 0; n < sb.ninodes - 1; n++){
+    inum = 1 + (start - 1 + n) % (sb.ninodes - 1);
+    if(bp == 0 || bp->blockno != IBLOCK(inum, sb)){
+      if(bp)
+        brelse(bp);
+      bp = bread(dev, IBLOCK(inum, sb));
+    }
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
+      if(type == T_FILE)
+        dip->flags = DI_INLINE;
       log_write(bp);   // mark it allocated on the disk
+      acquire(&alloc.ilock);
+      alloc.nifree--;
+      alloc.ihint[id] = inum + 1 < sb.ninodes ? inum + 1 : 1;
+      release(&alloc.ilock);
       brelse(bp);
       return iget(dev, inum);
     }
-    brelse(bp);
   }
+  if(bp)
+    brelse(bp);
   panic("ialloc: no inodes");
 }
 
@@ -231,7 +523,8 @@ iupdate(struct inode *ip)
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
   dip->size = ip->size;
-  memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
+  dip->flags = ip->flags;
+  memmove(dip->data, ip->data, sizeof(ip->data));
   log_write(bp);
   brelse(bp);
 }
@@ -242,31 +535,49 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
+  int h = ihash(dev, inum);
 
   acquire(&icache.lock);
 
-  // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&icache.lock);
-      return ip;
+  while(1){
+    // Is the inode already cached?
+    for(ip = icache.hash[h]; ip; ip = ip->next){
+      if(ip->dev == dev && ip->inum == inum){
+        if(ip->ref++ == 0)
+          lruremove(ip);
+        release(&icache.lock);
+        return ip;
+      }
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+
+    if(icache.free || icache.ninode + INODEPERPAGE > INODELIMIT)
+      break;
+    // grow, and look again, since the lock was released.
+    release(&icache.lock);
+    if(!igrow()){
+      acquire(&icache.lock);
+      break;
+    }
+    acquire(&icache.lock);
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
+  // Use a free cache entry, or recycle the least recently
+  // used one.
+  if((ip = icache.free) != 0){
+    icache.free = ip->next;
+  } else if((ip = icache.lru.lnext) != &icache.lru){
+    lruremove(ip);
+    iunhash(ip);
+  } else
     panic("iget: no inodes");
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->next = icache.hash[h];
+  icache.hash[h] = ip;
   release(&icache.lock);
 
   return ip;
@@ -304,7 +615,8 @@ ilock(struct inode *ip)
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
-    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->flags = dip->flags;
+    memmove(ip->data, dip->data, sizeof(ip->data));
     brelse(bp);
     ip->valid = 1;
     if(ip->type == 0)
@@ -322,6 +634,36 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Lock the given inode shared with other readers, for
+// paths that only read it (readi(), stati(), dirlookup()).
+// Reads the inode from disk if necessary.
+void
+ilock_shared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilock_shared");
+
+  acquiresleep_shared(&ip->lock);
+
+  // valid only changes under the exclusive lock.
+  if(ip->valid == 0){
+    // loading the inode needs the lock to ourselves.
+    releasesleep_shared(&ip->lock);
+    ilock(ip);
+    downgradesleep(&ip->lock);
+  }
+}
+
+// Unlock an inode locked with ilock_shared().
+void
+iunlock_shared(struct inode *ip)
+{
+  if(ip == 0 || !holdingsleep_shared(&ip->lock) || ip->ref < 1)
+    panic("iunlock_shared");
+
+  releasesleep_shared(&ip->lock);
+}
+
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode cache entry can
 // be recycled.
@@ -347,13 +689,29 @@ iput(struct inode *ip)
     ip->type = 0;
     iupdate(ip);
     ip->valid = 0;
+    acquire(&alloc.ilock);
+    alloc.nifree++;
+    release(&alloc.ilock);
+    dcache_purge(ip->dev, ip->inum);
 
     releasesleep(&ip->lock);
 
     acquire(&icache.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    // keep it cached, to be recycled when least recently
+    // used, or first if it no longer holds an inode.
+    if(ip->valid){
+      ip->lprev = icache.lru.lprev;
+      ip->lnext = &icache.lru;
+    } else {
+      ip->lprev = &icache.lru;
+      ip->lnext = icache.lru.lnext;
+    }
+    ip->lprev->lnext = ip;
+    ip->lnext->lprev = ip;
+  }
   release(&icache.lock);
 }
 
@@ -370,48 +728,103 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT]. The NINDIRECT^2 after
+// those are listed in the blocks listed in the double
+// indirect block ip->addrs[NDIRECT+1], and the NINDIRECT^3
+// after those one level further down, from the triple
+// indirect block ip->addrs[NDIRECT+2].
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
+  uint addr, *a, nmap, goal;
   struct buf *bp;
+  int level, i;
 
+  // allocate blocks just after the file's previous block,
+  // or the indirect block that lists them, where possible.
   if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+    if((addr = ip->addrs[bn]) == 0){
+      goal = bn > 0 && ip->addrs[bn-1] ? ip->addrs[bn-1] + 1 : 0;
+      ip->addrs[bn] = addr = balloc(ip->dev, goal);
+    }
     return addr;
   }
   bn -= NDIRECT;
 
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+  // find the levels of indirection, and how many blocks
+  // that maps, for bn.
+  nmap = NINDIRECT;
+  for(level = 0; level < NLEVEL && bn >= nmap; level++){
+    bn -= nmap;
+    nmap *= NINDIRECT;
+  }
+  if(level == NLEVEL)
+    panic("bmap: out of range");
+
+  // Load indirect blocks down to bn, allocating if necessary.
+  if((addr = ip->addrs[NDIRECT+level]) == 0){
+    goal = ip->addrs[NDIRECT-1] ? ip->addrs[NDIRECT-1] + 1 : 0;
+    ip->addrs[NDIRECT+level] = addr = balloc(ip->dev, goal);
+    bzero(ip->dev, addr);
+  }
+  for(; level >= 0; level--){
+    nmap /= NINDIRECT;  // blocks each entry of this one maps
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+    i = bn / nmap;
+    if((addr = a[i]) == 0){
+      goal = i > 0 && a[i-1] ? a[i-1] + 1 : bp->blockno + 1;
+      a[i] = addr = balloc(ip->dev, goal);
+      if(level > 0)
+        bzero(ip->dev, addr);
       log_write(bp);
     }
     brelse(bp);
-    return addr;
+    bn %= nmap;
   }
+  return addr;
+}
+
+// Free indirect block addr, and the blocks it lists, with
+// level more levels of indirect blocks below it.
+static void
+ifree(uint dev, uint addr, int level)
+{
+  int j;
+  struct buf *bp;
+  uint *a;
 
-  panic("bmap: out of range");
+  bp = bread(dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j] == 0)
+      continue;
+    if(level > 0)
+      ifree(dev, a[j], level-1);
+    else
+      bfree(dev, a[j]);
+  }
+  brelse(bp);
+  bfree(dev, addr);
 }
 
-// Truncate inode (discard contents).
+// Truncate inode (discard contents). A file becomes
+// inline again.
 // Caller must hold ip->lock.
 void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
+
+  if(ip->flags & DI_INLINE){
+    memset(ip->data, 0, sizeof(ip->data));
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
@@ -420,24 +833,43 @@ itrunc(struct inode *ip)
     }
   }
 
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
+  for(i = 0; i < NLEVEL; i++){
+    if(ip->addrs[NDIRECT+i]){
+      ifree(ip->dev, ip->addrs[NDIRECT+i], i);
+      ip->addrs[NDIRECT+i] = 0;
     }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->type == T_FILE)
+    ip->flags |= DI_INLINE;
   ip->size = 0;
   iupdate(ip);
 }
 
-// Copy stat information from inode.
+// Move an inline file's data out to a block, so that it
+// can grow past NINLINE bytes.
 // Caller must hold ip->lock.
+static void
+iexpand(struct inode *ip)
+{
+  char data[NINLINE];
+  struct buf *bp;
+
+  memmove(data, ip->data, sizeof(data));
+  memset(ip->data, 0, sizeof(ip->data));
+  ip->flags &= ~DI_INLINE;
+  if(ip->size > 0){
+    bp = bread(ip->dev, bmap(ip, 0));
+    memset(bp->data, 0, BSIZE);
+    memmove(bp->data, data, ip->size);
+    log_write(bp);
+    brelse(bp);
+  }
+  iupdate(ip);
+}
+
+// Copy stat information from inode.
+// Caller must hold ip->lock, perhaps shared.
 void
 stati(struct inode *ip, struct stat *st)
 {
@@ -449,7 +881,7 @@ stati(struct inode *ip, struct stat *st)
 }
 
 // Read data from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, perhaps shared.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
 int
@@ -463,6 +895,12 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
+  if(ip->flags & DI_INLINE){
+    if(either_copyout(user_dst, dst, ip->data + off, n) == -1)
+      return -1;
+    return n;
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
@@ -476,6 +914,34 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// Start reading n blocks of ip's content, from block bn on,
+// into the buffer cache without waiting for them. Stops at
+// the end of the file.
+// Caller must hold ip->lock, perhaps shared.
+void
+iprefetch(struct inode *ip, uint bn, uint n)
+{
+  uint nblock = (ip->size + BSIZE - 1) / BSIZE;
+
+  if(ip->flags & DI_INLINE)
+    return;
+  for(; n > 0 && bn < nblock; bn++, n--)
+    bprefetch(ip->dev, bmap(ip, bn));
+}
+
+// Wait for writei()'s in-place writes of bufs[0..n-1] and
+// release them.
+static void
+inplace_wait(struct buf **bufs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    bwait(bufs[i]);
+    brelse(bufs[i]);
+  }
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -484,24 +950,56 @@ int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
   uint tot, m;
-  struct buf *bp;
+  struct buf *bp, *inplace[NINPLACE];
+  int ninplace = 0;
 
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  if(ip->flags & DI_INLINE){
+    if(off + n > NINLINE){
+      iexpand(ip);
+    } else {
+      if(either_copyin(ip->data + off, user_src, src, n) == -1)
+        n = -1;
+      else if(off + n > ip->size)
+        ip->size = off + n;
+      iupdate(ip);
+      return n;
+    }
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    if(off - off%BSIZE >= ip->size){
+      // past the end of the file, so maybe just allocated
+      // by bmap() and holding garbage.
+      memset(bp->data, 0, BSIZE);
+    }
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
       n = -1;
       break;
     }
-    log_write(bp);
-    brelse(bp);
+    if(ip->type == T_FILE && log_inplace(bp)){
+      // ordered mode: write file data in place, to be on
+      // disk before this transaction commits, rather than
+      // through the log.
+      bwrite_async(bp);
+      inplace[ninplace++] = bp;
+      if(ninplace == NINPLACE){
+        inplace_wait(inplace, ninplace);
+        ninplace = 0;
+      }
+    } else {
+      log_write(bp);
+      brelse(bp);
+    }
   }
+  inplace_wait(inplace, ninplace);
 
   if(n > 0){
     if(off > ip->size)
@@ -523,18 +1021,327 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Indexed directories; see struct dxslot in fs.h.
+
+// Where a name hash leads in an indexed directory.
+struct dxpath {
+  int r;        // root slot
+  uint iblk;    // index block it lists
+  int i;        // slot in that
+  int n;        // slots in use in that
+  uint leaf;    // leaf block it lists
+};
+
+static uint
+dxhash(char *name)
+{
+  uint h = 2166136261;  // FNV-1a
+
+  for(int i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// Return a locked buf with block bn of directory dp.
+static struct buf*
+dxread(struct inode *dp, uint bn)
+{
+  if(bn >= dp->size / BSIZE)
+    panic("dxread");
+  return bread(dp->dev, bmap(dp, bn));
+}
+
+// Add a zeroed block to the end of directory dp, setting
+// *bn to its number. Returns its locked buf, which the
+// caller must log_write().
+static struct buf*
+dxappend(struct inode *dp, uint *bn)
+{
+  struct buf *bp;
+
+  *bn = dp->size / BSIZE;
+  bp = bread(dp->dev, bmap(dp, *bn));
+  memset(bp->data, 0, BSIZE);
+  dp->size += BSIZE;
+  iupdate(dp);
+  return bp;
+}
+
+static int
+dxindexed(struct inode *dp)
+{
+  struct buf *bp;
+  struct dxslot *s;
+  int r;
+
+  if(dp->size <= BSIZE)
+    return 0;
+  bp = dxread(dp, 0);
+  s = (struct dxslot*)bp->data;
+  r = s[2].zero == 0 && s[2].block == DXMAGIC;
+  brelse(bp);
+  return r;
+}
+
+// Return the last of the n sorted slots s[] whose hash is
+// at most h.
+static int
+dxsearch(struct dxslot *s, int n, uint h)
+{
+  int lo, hi, mid;
+
+  lo = 0;
+  hi = n - 1;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(s[mid].hash <= h)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+// Follow hash h from the root of indexed directory dp.
+static void
+dxwalk(struct inode *dp, uint h, struct dxpath *p)
+{
+  struct buf *bp;
+  struct dxslot *s;
+
+  bp = dxread(dp, 0);
+  s = (struct dxslot*)bp->data;
+  p->r = dxsearch(s+3, s[2].hash, h);
+  p->iblk = s[3+p->r].block;
+  brelse(bp);
+
+  bp = dxread(dp, p->iblk);
+  s = (struct dxslot*)bp->data;
+  p->n = s[0].hash;
+  p->i = dxsearch(s+1, p->n, h);
+  p->leaf = s[1+p->i].block;
+  brelse(bp);
+}
+
+// Index directory dp, whose one block is full: move the
+// entries other than "." and ".." to a leaf, listed by a new
+// index block, and put the root in their place.
+// Returns -1 if dp doesn't start with "." and "..".
+static int
+dxconvert(struct inode *dp)
+{
+  struct buf *bp, *lbp, *ibp;
+  struct dirent *de;
+  struct dxslot *s;
+  uint lb, ib;
+
+  bp = dxread(dp, 0);
+  de = (struct dirent*)bp->data;
+  if(de[0].inum == 0 || namecmp(de[0].name, ".") != 0 ||
+     de[1].inum == 0 || namecmp(de[1].name, "..") != 0){
+    brelse(bp);
+    return -1;
+  }
+
+  lbp = dxappend(dp, &lb);
+  memmove(lbp->data, de+2, (DPB-2) * sizeof(*de));
+  ibp = dxappend(dp, &ib);
+  s = (struct dxslot*)ibp->data;
+  s[0].block = DXMAGIC;
+  s[0].hash = 1;
+  s[1].block = lb;
+  s[1].hash = 0;
+
+  memset(de+2, 0, (DPB-2) * sizeof(*de));
+  s = (struct dxslot*)bp->data;
+  s[2].block = DXMAGIC;
+  s[2].hash = 1;
+  s[3].block = ib;
+  s[3].hash = 0;
+
+  log_write(lbp);
+  log_write(ibp);
+  log_write(bp);
+  brelse(ibp);
+  brelse(lbp);
+  brelse(bp);
+  return 0;
+}
+
+// Split p's index block, which is full, moving the upper
+// half of its slots to a new index block listed in the root.
+// Returns -1 if the root is full.
+static int
+dxsplitindex(struct inode *dp, struct dxpath *p)
+{
+  struct buf *bp, *ibp, *nbp;
+  struct dxslot *root, *s, *ns;
+  uint nb;
+  int nroot, k;
+
+  bp = dxread(dp, 0);
+  root = (struct dxslot*)bp->data;
+  nroot = root[2].hash;
+  if(nroot == DXROOT){
+    brelse(bp);
+    return -1;
+  }
+
+  ibp = dxread(dp, p->iblk);
+  s = (struct dxslot*)ibp->data;
+  nbp = dxappend(dp, &nb);
+  ns = (struct dxslot*)nbp->data;
+  k = p->n / 2;
+  ns[0].block = DXMAGIC;
+  ns[0].hash = p->n - k;
+  memmove(ns+1, s+1+k, (p->n - k) * sizeof(*s));
+  memset(s+1+k, 0, (p->n - k) * sizeof(*s));
+  s[0].hash = k;
+
+  memmove(root+3+p->r+2, root+3+p->r+1, (nroot - p->r - 1) * sizeof(*s));
+  root[3+p->r+1].block = nb;
+  root[3+p->r+1].hash = ns[1].hash;
+  root[2].hash++;
+
+  log_write(nbp);
+  log_write(ibp);
+  log_write(bp);
+  brelse(nbp);
+  brelse(ibp);
+  brelse(bp);
+  return 0;
+}
+
+// Split p's leaf, which is full, moving the entries with
+// the upper half of its hashes to a new leaf listed after it
+// in p's index block, which must have room.
+// Returns -1 if every entry has the same hash.
+static int
+dxsplitleaf(struct inode *dp, struct dxpath *p)
+{
+  struct buf *bp, *ibp, *nbp;
+  struct dirent *de, *nde;
+  struct dxslot *s;
+  uint hash[DPB], h, mid, nb;
+  int i, j, k;
+
+  bp = dxread(dp, p->leaf);
+  de = (struct dirent*)bp->data;
+  for(i = 0; i < DPB; i++){
+    h = dxhash(de[i].name);
+    for(j = i; j > 0 && hash[j-1] > h; j--)
+      hash[j] = hash[j-1];
+    hash[j] = h;
+  }
+  // split at the median hash, or the nearest change of hash
+  // to it, keeping equal hashes together.
+  k = -1;
+  for(i = 0; i < DPB/2 && k < 0; i++){
+    if(hash[DPB/2+i] != hash[DPB/2+i-1])
+      k = DPB/2 + i;
+    else if(hash[DPB/2-i] != hash[DPB/2-i-1])
+      k = DPB/2 - i;
+  }
+  if(k < 0){
+    brelse(bp);
+    return -1;
+  }
+  mid = hash[k];
+
+  nbp = dxappend(dp, &nb);
+  nde = (struct dirent*)nbp->data;
+  for(i = j = 0; i < DPB; i++){
+    if(dxhash(de[i].name) >= mid){
+      nde[j++] = de[i];
+      memset(&de[i], 0, sizeof(de[i]));
+    }
+  }
+
+  ibp = dxread(dp, p->iblk);
+  s = (struct dxslot*)ibp->data;
+  memmove(s+1+p->i+2, s+1+p->i+1, (p->n - p->i - 1) * sizeof(*s));
+  s[1+p->i+1].block = nb;
+  s[1+p->i+1].hash = mid;
+  s[0].hash++;
+
+  log_write(nbp);
+  log_write(bp);
+  log_write(ibp);
+  brelse(ibp);
+  brelse(nbp);
+  brelse(bp);
+  return 0;
+}
+
+// Add (name, inum) to indexed directory dp, in the leaf for
+// name's hash, splitting the leaf, and the index block that
+// lists it, if they are full.
+// This sets MAXOPBLOCKS: a mkdir that splits both writes the
+// new inode's block, dp's inode block, the bitmap, the new
+// directory's first block, the old index block, the root,
+// the old leaf, and the new index block and leaf, and the
+// two appends may write 3 indirect blocks between them (the
+// one the first lands in, and the double indirect block and
+// a new one under it for the second): 12 blocks.
+static int
+dxlink(struct inode *dp, char *name, uint inum)
+{
+  struct dxpath p;
+  struct buf *bp;
+  struct dirent *de;
+  uint h = dxhash(name);
+  int i;
+
+  while(1){
+    dxwalk(dp, h, &p);
+    bp = dxread(dp, p.leaf);
+    de = (struct dirent*)bp->data;
+    for(i = 0; i < DPB; i++){
+      if(de[i].inum == 0){
+        strncpy(de[i].name, name, DIRSIZ);
+        de[i].inum = inum;
+        log_write(bp);
+        brelse(bp);
+        return 0;
+      }
+    }
+    brelse(bp);
+    if(p.n == DXPERBLK){
+      if(dxsplitindex(dp, &p) < 0)
+        return -1;
+    } else if(dxsplitleaf(dp, &p) < 0)
+      return -1;
+  }
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
+  uint off, end, inum;
   struct dirent de;
+  struct dxpath p;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
+  // only look in the block that may have name, if indexed.
+  off = 0;
+  end = dp->size;
+  if(dxindexed(dp)){
+    if(namecmp(name, ".") == 0 || namecmp(name, "..") == 0){
+      end = 2*sizeof(de);
+    } else {
+      dxwalk(dp, dxhash(name), &p);
+      off = p.leaf * BSIZE;
+      end = off + BSIZE;
+    }
+  }
+
+  for(; off < end; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
     if(de.inum == 0)
@@ -551,19 +1358,15 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   return 0;
 }
 
-// Write a new directory entry (name, inum) into the directory dp.
-int
-dirlink(struct inode *dp, char *name, uint inum)
+// Add (name, inum) to directory dp, which doesn't have name.
+static int
+direnter(struct inode *dp, char *name, uint inum)
 {
   int off;
   struct dirent de;
-  struct inode *ip;
 
-  // Check that name is not present.
-  if((ip = dirlookup(dp, name, 0)) != 0){
-    iput(ip);
-    return -1;
-  }
+  if(dxindexed(dp))
+    return dxlink(dp, name, inum);
 
   // Look for an empty dirent.
   for(off = 0; off < dp->size; off += sizeof(de)){
@@ -573,6 +1376,10 @@ dirlink(struct inode *dp, char *name, uint inum)
       break;
   }
 
+  // index a directory as it outgrows its first block.
+  if(off == BSIZE && dp->size == BSIZE && dxconvert(dp) == 0)
+    return dxlink(dp, name, inum);
+
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
@@ -581,6 +1388,27 @@ dirlink(struct inode *dp, char *name, uint inum)
   return 0;
 }
 
+// Write a new directory entry (name, inum) into the directory dp.
+// Returns -1 if name is present, or an indexed directory has no
+// room for it (see dxlink()).
+int
+dirlink(struct inode *dp, char *name, uint inum)
+{
+  struct inode *ip;
+
+  // Check that name is not present.
+  if((ip = dirlookup(dp, name, 0)) != 0){
+    iput(ip);
+    return -1;
+  }
+
+  if(direnter(dp, name, inum) < 0)
+    return -1;
+  // replace a cached absence of name.
+  dcache_insert(dp->dev, dp->inum, name, inum);
+  return 0;
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -620,6 +1448,62 @@ skipelem(char *path, char *name)
   return path;
 }
 
+// Try to look up a path name using only the directory entry
+// cache (see dcache.c), without locking any inode, as namex()
+// does. Returns the inode, referenced but not locked, or 0
+// and sets *absent if some element is cached as absent. Else
+// returns 0 if some element isn't cached or the cache changed
+// meanwhile, in which case the caller should do the locked
+// walk.
+static struct inode*
+namefast(char *path, int nameiparent, char *name, int *absent)
+{
+  struct inode *ip;
+  uint dev, inum, seq;
+  int isdir;
+
+  if(*path == '/'){
+    dev = ROOTDEV;
+    inum = ROOTINO;
+  } else {
+    dev = myproc()->cwd->dev;
+    inum = myproc()->cwd->inum;
+  }
+  isdir = 1;
+  *absent = 0;
+
+  seq = dcache_seq();
+  rcu_read_lock();
+  while((path = skipelem(path, name)) != 0){
+    if(nameiparent && *path == '\0')
+      break;
+    if(!dcache_lookup(dev, inum, name, &inum, &isdir)){
+      rcu_read_unlock();
+      return 0;
+    }
+    if(inum == 0){
+      rcu_read_unlock();
+      *absent = dcache_seq() == seq;
+      return 0;
+    }
+  }
+  rcu_read_unlock();
+
+  // leave paths with no final element, and parents that may
+  // not be directories, to the locked walk.
+  if(nameiparent && (path == 0 || !isdir))
+    return 0;
+
+  ip = iget(dev, inum);
+  if(dcache_seq() != seq){
+    // an entry we used may have been removed, and its inode
+    // freed and reused, since we looked it up.
+    iput(ip);
+    return 0;
+  }
+  return ip;
+}
+
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
@@ -628,28 +1512,48 @@ static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
+  char pname[DIRSIZ];
+  uint pdir;
+  int absent;
+
+  if((ip = namefast(path, nameiparent, name, &absent)) != 0 || absent)
+    return ip;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
     ip = idup(myproc()->cwd);
 
+  pdir = 0;
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    // the walk only reads directories, so processes looking
+    // up paths through the same directories don't serialize.
+    ilock_shared(ip);
     if(ip->type != T_DIR){
-      iunlockput(ip);
+      iunlock_shared(ip);
+      iput(ip);
       return 0;
     }
+    if(pdir)
+      dcache_setdir(ip->dev, pdir, pname, ip->inum);
     if(nameiparent && *path == '\0'){
       // Stop one level early.
-      iunlock(ip);
+      iunlock_shared(ip);
       return ip;
     }
     if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
+      dcache_insert(ip->dev, ip->inum, name, 0);
+      iunlock_shared(ip);
+      iput(ip);
       return 0;
     }
-    iunlockput(ip);
+    // cache what we found for namefast(), while we still
+    // hold ip's lock, which keeps the entry from going away.
+    dcache_insert(ip->dev, ip->inum, name, next->inum);
+    pdir = ip->inum;
+    memmove(pname, name, DIRSIZ);
+    iunlock_shared(ip);
+    iput(ip);
     ip = next;
   }
   if(nameiparent){
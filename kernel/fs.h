@@ -20,24 +20,42 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint flags;        // FS_ flags below
 };
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+#define FS_ORDERED 0x1  // log only metadata; write file data in place
+
+#define NDIRECT 10
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NLEVEL 3  // single, double and triple indirect blocks
+#define MAXFILE (NDIRECT + NINDIRECT + NINDIRECT*NINDIRECT + \
+                 NINDIRECT*NINDIRECT*NINDIRECT)
+
+#define NINLINE 112  // bytes of data a dinode can hold itself
 
-// On-disk inode structure
+// On-disk inode structure. A file of up to NINLINE bytes
+// keeps its data in the inode, in data[], rather than in
+// blocks listed in addrs[], while DI_INLINE is set in flags.
+// It is cleared when the file grows too big, and set again
+// when it is truncated. Only files are ever inline.
 struct dinode {
   short type;           // File type
   short major;          // Major device number (T_DEVICE only)
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  short flags;          // DI_ flags below
+  short pad;
+  union {
+    uint addrs[NDIRECT+NLEVEL];   // Data block addresses
+    char data[NINLINE];           // or the data itself
+  };
 };
 
+#define DI_INLINE 0x1  // data is in the inode
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -58,3 +76,25 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Dirents per block
+#define DPB           (BSIZE / sizeof(struct dirent))
+
+// A directory that outgrows its first block is indexed by a
+// hash of the names. Its first block keeps "." and "..", then
+// a header slot and the root of the index: a sorted list of
+// index blocks, each a header slot and a sorted list of leaf
+// blocks. A leaf holds the entries whose name hashes are at
+// least its slot's hash and less than the next slot's.
+// Index slots have inum 0, so the directory still reads as
+// a list of entries.
+struct dxslot {
+  ushort zero;    // a dirent's inum: always 0
+  ushort block;   // directory block, or DXMAGIC in a header
+  uint hash;      // least name hash in it, or header's count
+  uint pad[2];
+};
+
+#define DXMAGIC  0xd1e5
+#define DXROOT   (DPB - 3)  // index blocks listed in the root
+#define DXPERBLK (DPB - 1)  // leaves listed in an index block
+
@@ -0,0 +1,97 @@
+//
+// Futexes: a kernel wait queue keyed by a user memory word.
+//
+// User code does the uncontended lock/unlock with atomic
+// instructions and only enters the kernel to wait while the
+// word still holds an expected value, or to wake waiters.
+// A futex is identified by the physical address of its word,
+// so processes sharing a page (see mshare()) agree on it.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+
+#define NFUTEXBUCKET 13
+
+// Each bucket lock serializes the value check in futexwait()
+// against futexwake() for every futex that hashes to it,
+// so a wakeup can't slip in between the check and the sleep.
+struct {
+  struct spinlock lock;
+} futexbucket[NFUTEXBUCKET];
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NFUTEXBUCKET; i++)
+    initlock(&futexbucket[i].lock, "futex");
+}
+
+static struct spinlock*
+futexlock(uint64 pa)
+{
+  return &futexbucket[(pa >> 2) % NFUTEXBUCKET].lock;
+}
+
+// Translate the user address of a futex word to its
+// physical address, or 0 if it is misaligned or not mapped.
+static uint64
+futexkey(uint64 uaddr)
+{
+  struct proc *p = myproc();
+
+  if(uaddr % sizeof(int) != 0 || uaddr >= p->sz)
+    return 0;
+  return walkaddrw(p->pagetable, uaddr);
+}
+
+// Sleep until woken by futexwake(), provided that the word
+// at uaddr still holds val.
+// Returns 0 when woken, -1 if the value differed, the
+// address was bad, or the process was killed.
+int
+futexwait(uint64 uaddr, int val)
+{
+  struct spinlock *lk;
+  uint64 pa;
+
+  if((pa = futexkey(uaddr)) == 0)
+    return -1;
+  lk = futexlock(pa);
+
+  acquire(lk);
+  if(*(volatile int*)pa != val){
+    release(lk);
+    return -1;
+  }
+  if(myproc()->killed){
+    release(lk);
+    return -1;
+  }
+  sleep((void*)pa, lk);
+  release(lk);
+  return 0;
+}
+
+// Wake at most n processes waiting on the futex at uaddr.
+// Returns the number woken, or -1 if the address was bad.
+int
+futexwake(uint64 uaddr, int n)
+{
+  struct spinlock *lk;
+  uint64 pa;
+  int woken;
+
+  if((pa = futexkey(uaddr)) == 0)
+    return -1;
+  lk = futexlock(pa);
+
+  acquire(lk);
+  woken = wakeupn((void*)pa, n);
+  release(lk);
+  return woken;
+}
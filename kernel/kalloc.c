@@ -1,6 +1,7 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// pipe buffers, and the disk block cache.
+// Allocates whole 4096-byte pages.
 
 #include "types.h"
 #include "param.h"
@@ -14,7 +15,7 @@ void freerange(void *pa_start, void *pa_end);
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
-uint8 refcount[(PHYSTOP - KERNBASE) >> PGSHIFT];
+uint16 refcount[(PHYSTOP - KERNBASE) >> PGSHIFT];
 struct spinlock reflock;
 
 #define REFCOUNTIDX(pa) ((PGROUNDDOWN(pa) - KERNBASE) >> PGSHIFT)
@@ -80,6 +81,7 @@ kalloc(void)
 {
     struct run *r;
 
+again:
     acquire(&kmem.lock);
     r = kmem.freelist;
     if (r)
@@ -94,14 +96,19 @@ kalloc(void)
     }
     release(&kmem.lock);
 
+    // Out of memory: take a page back from the buffer cache,
+    // or the inode cache.
+    if (!r && (breclaim() || ireclaim()))
+        goto again;
+
     if (r)
         memset((char *)r, 5, PGSIZE); // fill with junk
     return (void *)r;
 }
 
-uint8 add_ref(uint64 pa, int delta)
+uint16 add_ref(uint64 pa, int delta)
 {
-    uint8 ref;
+    uint16 ref;
     int idx = REFCOUNTIDX((uint64)pa);
     // printf("add ref: %p %d\n", pa, idx);
     acquire(&reflock);
@@ -112,17 +119,17 @@ uint8 add_ref(uint64 pa, int delta)
     return ref;
 }
 
-uint8 increment_ref(uint64 pa)
+uint16 increment_ref(uint64 pa)
 {
     return add_ref(pa, 1);
 }
 
-uint8 decrement_ref(uint64 pa)
+uint16 decrement_ref(uint64 pa)
 {
     return add_ref(pa, -1);
 }
 
-uint8 get_ref(uint64 pa)
+uint16 get_ref(uint64 pa)
 {
     return add_ref(pa, 0);
 }
@@ -0,0 +1,8 @@
+// Contention statistics for one class of spinlocks (all
+// locks with the same name), returned by lockstat().
+struct lockstat {
+  char name[16];     // Lock name
+  uint64 nacquire;   // Acquisitions
+  uint64 ncontended; // Acquisitions that had to wait
+  uint64 nspin;      // Spin loop iterations while waiting
+};
@@ -6,201 +6,468 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "memlayout.h"
+#include "logstat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
-// any reasoning required about whether a commit might
+// calls. The logging system only closes a transaction when
+// there are no FS system calls active in it. Thus there is
+// never any reasoning required about whether a commit might
 // write an uncommitted system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
-// its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
-// But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// its start and end. Usually begin_op() just reserves
+// MAXOPBLOCKS of log space for the system call and returns.
+// But if the log is close to running out, it sleeps until
+// the last outstanding end_op() commits. end_op() returns
+// once the transaction has committed. A system call that
+// may write more, like a large write(), reserves a bigger
+// share of the log with begin_opn()/end_opn().
+//
+// In lazy mode (LOG_LAZY), end_op() doesn't commit or wait:
+// transactions accumulate in memory until the log is nearly
+// full, someone calls log_sync() (fsync()), or the flusher
+// thread commits them every LOGFLUSH ticks.
+//
+// Transactions are double-buffered: closing one copies its
+// blocks aside (see snapshot()), and new system calls join
+// the next transaction while the copies are written to disk.
+// System calls that end while a commit runs are committed
+// together by the next one (group commit).
 //
 // The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
+// Its size comes from the superblock. The on-disk log format:
+//   header blocks, containing block #s for block A, B, C, ...
 //   block A
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Log appends are all started at once, and the commit waits
+// for them to finish before writing the header.
+//
+// The header is n followed by the block #s, as ints filling
+// as many header blocks as a log of that size needs. The
+// first header block, with n, is written last: that is the
+// commit point.
+
+#define HDRINTS ((int)(BSIZE/sizeof(int))) // ints per header block
+#define NFREED 64   // freed blocks remembered per transaction
 
-// Contents of the header block, used for both the on-disk header block
-// and to keep track in memory of logged block# before commit.
+// The log header, to keep track in memory of logged block#
+// before commit.
 struct logheader {
   int n;
-  int block[LOGSIZE];
+  int block[MAXLOGSIZE];
 };
 
 struct log {
   struct spinlock lock;
   int start;
-  int size;
+  int nhdr;        // header blocks
+  int max;         // data blocks after them
+  int size;        // how many of those to use; see logsize()
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // log blocks they may write.
+  int nwait;       // sys calls waiting for log space.
+  int committing;  // commit() is running.
   int dev;
+  int mode;        // LOG_ORDERED, LOG_LAZY
+  int nsync;       // log_sync() calls waiting for a commit
+
+  // the open transaction.
   struct logheader lh;
+  struct buf *buf[MAXLOGSIZE]; // pinned cache bufs of lh.block[]
+  int nop;                  // sys calls that have joined it
+  uint seq;                 // its number
+  int nfreed;               // blocks it has freed, up to NFREED+1
+  uint freed[NFREED];       // the first NFREED of them
+
+  uint done;                // number of the last committed transaction
+
+  // the transaction being committed, with its blocks as they
+  // were when it closed. snap[] aren't cache bufs: the cached
+  // blocks may change under the next transaction meanwhile.
+  struct logheader ch;
+  struct buf *cbuf[MAXLOGSIZE];
+  struct buf *snap[MAXLOGSIZE]; // in pages from kalloc()
+  int cnfreed;
+  uint cfreed[NFREED];
+
+  struct logstat stat;      // for logstat()
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void loghist(uint64);
+static void log_flusher(void);
 
 void
 initlog(int dev, struct superblock *sb)
 {
-  if (sizeof(struct logheader) >= BSIZE)
-    panic("initlog: too big logheader");
+  struct buf *pg = 0;
+  int i, per;
 
   initlock(&log.lock, "log");
   log.start = sb->logstart;
-  log.size = sb->nlog;
+  log.nhdr = 1;
+  while (1 + sb->nlog - log.nhdr > log.nhdr * HDRINTS)
+    log.nhdr++;
+  log.max = sb->nlog - log.nhdr;
+  if (log.max > MAXLOGSIZE)
+    log.max = MAXLOGSIZE;
+  if (log.max < MAXOPBLOCKS)
+    panic("initlog: log too small");
+  log.size = log.max;
   log.dev = dev;
+
+  per = PGSIZE / sizeof(struct buf);
+  for (i = 0; i < log.max; i++) {
+    if (i % per == 0) {
+      if ((pg = (struct buf*)kalloc()) == 0)
+        panic("initlog: kalloc");
+      memset(pg, 0, PGSIZE);
+    }
+    log.snap[i] = &pg[i % per];
+  }
+  // the open and the committing transactions may each pin
+  // a cache buffer per log block.
+  bcachemin(2*log.max + MAXOPBLOCKS);
+
+  if (sb->flags & FS_ORDERED)
+    log.mode |= LOG_ORDERED;
+  log.seq = 1;
   recover_from_log();
+  kthread("logflush", log_flusher);
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from snap[] to their home location,
+// with all the writes in flight at once.
 static void
 install_trans(void)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
-  }
+  for (tail = 0; tail < log.ch.n; tail++)
+    bstart(log.snap[tail], log.dev, log.ch.block[tail], 1); // write dst
+  for (tail = 0; tail < log.ch.n; tail++)
+    bwait(log.snap[tail]);
 }
 
-// Read the log header from disk into the in-memory log header
+// Read the log header from disk into the committing log header
 static void
 read_head(void)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
+  int *hb = (int *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  log.ch.n = hb[0];
+  if (log.ch.n < 0 || log.ch.n > log.max)
+    panic("read_head");
+  for (i = 0; i < log.ch.n; i++) {
+    if ((i+1) % HDRINTS == 0) {
+      brelse(buf);
+      buf = bread(log.dev, log.start + (i+1) / HDRINTS);
+      hb = (int *) (buf->data);
+    }
+    log.ch.block[i] = hb[(i+1) % HDRINTS];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Write the committing log header to disk, the first
+// header block last. Writing the first header block is
+// the true point at which the transaction commits.
 static void
 write_head(void)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
-  int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  struct buf *buf;
+  int *hb;
+  int i, j;
+
+  for (j = log.ch.n / HDRINTS; j >= 0; j--) {
+    buf = bread(log.dev, log.start + j);
+    hb = (int *) (buf->data);
+    for (i = j*HDRINTS; i < (j+1)*HDRINTS && i <= log.ch.n; i++)
+      hb[i - j*HDRINTS] = i == 0 ? log.ch.n : log.ch.block[i-1];
+    bwrite(buf);
+    brelse(buf);
   }
-  bwrite(buf);
-  brelse(buf);
 }
 
 static void
 recover_from_log(void)
 {
+  int tail;
+
   read_head();
-  install_trans(); // if committed, copy from log to disk
-  log.lh.n = 0;
+  // if committed, copy from log to disk. this is the only
+  // time the log blocks are read back.
+  for (tail = 0; tail < log.ch.n; tail++)
+    bstart(log.snap[tail], log.dev, log.start+log.nhdr+tail, 0); // read log block
+  for (tail = 0; tail < log.ch.n; tail++)
+    bwait(log.snap[tail]);
+  install_trans();
+  log.ch.n = 0;
   write_head(); // clear the log
 }
 
+// The most log blocks one system call may reserve: a third
+// of the log, so that a few large writes can share a
+// transaction. Caller must hold log.lock.
+static int
+opmax(void)
+{
+  return log.size/3 > MAXOPBLOCKS ? log.size/3 : MAXOPBLOCKS;
+}
+
+// Wait for the open transaction to make room: commit it
+// now if lazy mode has left it open with no system call in
+// it, or else sleep until a commit.
+// Caller must hold log.lock.
+static void
+logwait(void)
+{
+  if(log.outstanding == 0 && !log.committing && log.nop > 0){
+    log.committing = 1;
+    commit();
+    log.committing = 0;
+  } else {
+    log.nwait++;
+    sleep(&log, &log.lock);
+    log.nwait--;
+  }
+}
+
 // called at the start of each FS system call.
 void
 begin_op(void)
 {
+  begin_opn(MAXOPBLOCKS);
+}
+
+// called at the start of an FS system call that would
+// like to write n blocks. reserves up to opmax() blocks,
+// waiting until the open transaction has room for them,
+// and returns how many; the caller must write no more,
+// and pass the same number to end_opn().
+int
+begin_opn(int n)
+{
+  int m;
+
+  if(n < MAXOPBLOCKS)
+    n = MAXOPBLOCKS;
   acquire(&log.lock);
   while(1){
-    if(log.committing){
-      sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    m = n < opmax() ? n : opmax();
+    if(log.lh.n + log.reserved + m > log.size){
       // this op might exhaust log space; wait for commit.
-      sleep(&log, &log.lock);
+      logwait();
     } else {
       log.outstanding += 1;
+      log.reserved += m;
+      log.nop += 1;
       release(&log.lock);
-      break;
+      return m;
     }
   }
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
 void
 end_op(void)
 {
-  int do_commit = 0;
+  end_opn(MAXOPBLOCKS);
+}
+
+// called at the end of an FS system call that reserved n
+// blocks. commits if this was the last outstanding
+// operation and no commit is running, and waits for this
+// operation's transaction to commit. in lazy mode, only
+// commits if the log is nearly full or someone is waiting
+// for it, and doesn't wait.
+void
+end_opn(int n)
+{
+  uint seq;
+  int lazy;
 
   acquire(&log.lock);
+  seq = log.seq;
+  lazy = log.mode & LOG_LAZY;
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
+  log.reserved -= n;
+  if(log.outstanding == 0 && !log.committing &&
+     (!lazy || log.nsync > 0 || log.nwait > 0 ||
+      log.lh.n + MAXOPBLOCKS > log.size)){
     log.committing = 1;
+    commit();
+    log.committing = 0;
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
     // the amount of reserved space.
     wakeup(&log);
   }
+  while(!lazy && log.done < seq)
+    sleep(&log, &log.lock);
   release(&log.lock);
+}
+
+// Commit every system call that has finished so far, and
+// wait for it to be on disk.
+void
+log_sync(void)
+{
+  uint seq;
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
+  acquire(&log.lock);
+  // the open transaction, or if no system call has joined
+  // it, the one before.
+  seq = log.nop > 0 ? log.seq : log.seq - 1;
+  log.nsync++;
+  if(log.outstanding == 0 && !log.committing){
+    log.committing = 1;
     commit();
-    acquire(&log.lock);
     log.committing = 0;
-    wakeup(&log);
+  }
+  // otherwise the last end_op() or the running commit()
+  // commits the open transaction.
+  while(log.done < seq)
+    sleep(&log, &log.lock);
+  log.nsync--;
+  release(&log.lock);
+}
+
+// Kernel thread that commits in the background in lazy mode.
+// Sleeps until logmode() turns lazy mode on.
+static void
+log_flusher(void)
+{
+  uint ticks0;
+
+  for(;;){
+    acquire(&log.lock);
+    while(!(log.mode & LOG_LAZY))
+      sleep(&log.mode, &log.lock);
     release(&log.lock);
+
+    acquire(&tickslock);
+    ticks0 = ticks;
+    while(ticks - ticks0 < LOGFLUSH)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+    if(log.mode & LOG_LAZY)
+      log_sync();
+  }
+}
+
+// Close the open transaction, copying its blocks into
+// snap[], and open the next. No system call is in the
+// transaction, so the blocks can't be changing.
+// Caller must hold log.lock.
+static void
+snapshot(void)
+{
+  int i;
+
+  log.ch.n = log.lh.n;
+  for (i = 0; i < log.lh.n; i++) {
+    log.ch.block[i] = log.lh.block[i];
+    log.cbuf[i] = log.buf[i];
+    memmove(log.snap[i]->data, log.buf[i]->data, BSIZE);
   }
+  log.cnfreed = log.nfreed;
+  memmove(log.cfreed, log.freed, sizeof(log.freed));
+  log.lh.n = 0;
+  log.nop = 0;
+  log.nfreed = 0;
+  log.seq++;
 }
 
-// Copy modified blocks from cache to log.
+// Write the snapshotted blocks to the log.
 static void
 write_log(void)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
-  }
+  for (tail = 0; tail < log.ch.n; tail++)
+    bstart(log.snap[tail], log.dev, log.start+log.nhdr+tail, 1); // write the log
+  for (tail = 0; tail < log.ch.n; tail++)
+    bwait(log.snap[tail]);
 }
 
+// Commit the open transaction, and then each one that
+// closes while the previous commit is running. Called and
+// returns holding log.lock, with log.committing set; releases
+// it while writing to disk.
 static void
 commit()
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  uint seq;
+  uint64 t0;
+  int i;
+
+  while (log.outstanding == 0 && log.nop > 0) {
+    seq = log.seq;
+    log.stat.nop += log.nop;
+    t0 = *(volatile uint64*)CLINT_MTIME;
+    snapshot();
+    log.stat.nblock += log.ch.n;
+    // begin_op() may be waiting for log space.
+    wakeup(&log);
+    release(&log.lock);
+
+    if (log.ch.n > 0) {
+      write_log();     // Write modified blocks from snapshots to log
+      write_head();    // Write header to disk -- the real commit
+      install_trans(); // Now install writes to home locations
+      for (i = 0; i < log.ch.n; i++)
+        bunpin(log.cbuf[i]);
+      log.ch.n = 0;
+      write_head();    // Erase the transaction from the log
+    }
+
+    acquire(&log.lock);
+    log.cnfreed = 0;
+    log.done = seq;
+    wakeup(&log);
+    log.stat.ncommit++;
+    // CLINT_MTIME counts about 10 cycles per microsecond in qemu.
+    loghist((*(volatile uint64*)CLINT_MTIME - t0) / 10);
   }
 }
 
+// Count a commit that took us microseconds.
+// Caller must hold log.lock.
+static void
+loghist(uint64 us)
+{
+  int i;
+
+  for (i = 0; i < NLOGHIST-1 && us >= 2; i++)
+    us >>= 1;
+  log.stat.hist[i]++;
+}
+
+// Copy the log statistics to user address addr, a struct
+// logstat, and then clear them if reset is set.
+int
+logstat(uint64 addr, int reset)
+{
+  struct logstat st;
+
+  acquire(&log.lock);
+  st = log.stat;
+  if (reset)
+    memset(&log.stat, 0, sizeof(log.stat));
+  release(&log.lock);
+  return either_copyout(1, addr, &st, sizeof(st));
+}
+
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
 // commit()/write_log() will do the disk write.
@@ -215,7 +482,7 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.size)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -227,9 +494,118 @@ log_write(struct buf *b)
   }
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n) {  // Add new block to log?
+    log.buf[i] = b;
     bpin(b);
     log.lh.n++;
   }
   release(&log.lock);
 }
 
+// Note that the current transaction frees block b, for
+// log_inplace(). Called by bfree().
+void
+log_free(uint b)
+{
+  acquire(&log.lock);
+  if (log.nfreed < NFREED)
+    log.freed[log.nfreed] = b;
+  if (log.nfreed <= NFREED)
+    log.nfreed++;
+  release(&log.lock);
+}
+
+// Was block b freed by a transaction with nfreed frees,
+// the first of them listed in freed[]? Assume so if there
+// were too many to list.
+static int
+wasfreed(uint b, uint *freed, int nfreed)
+{
+  int i;
+
+  if (nfreed > NFREED)
+    return 1;
+  for (i = 0; i < nfreed; i++) {
+    if (freed[i] == b)
+      return 1;
+  }
+  return 0;
+}
+
+// In ordered mode, may file data block b be written straight
+// to its home location, rather than through the log? Not if
+// a transaction that is open or committing has logged it,
+// perhaps as metadata before it was freed: installing that
+// transaction would overwrite the data. Nor if one of them
+// freed it: until that commits, a crash would leave the
+// block in the file that had it, holding the new data.
+// Caller must be in a transaction; the data must reach the
+// disk before that transaction commits.
+int
+log_inplace(struct buf *b)
+{
+  int i, ok;
+
+  if (!(log.mode & LOG_ORDERED))
+    return 0;
+  ok = 1;
+  acquire(&log.lock);
+  for (i = 0; i < log.lh.n; i++) {
+    if (log.lh.block[i] == b->blockno)
+      ok = 0;
+  }
+  for (i = 0; i < log.ch.n; i++) {
+    if (log.ch.block[i] == b->blockno)
+      ok = 0;
+  }
+  if (wasfreed(b->blockno, log.freed, log.nfreed) ||
+      wasfreed(b->blockno, log.cfreed, log.cnfreed))
+    ok = 0;
+  release(&log.lock);
+  return ok;
+}
+
+// Set the log mode: LOG_ORDERED to log only metadata, as if
+// the file system had been made that way, and LOG_LAZY to
+// commit in the background. Leaving lazy mode commits what
+// has accumulated. Returns the previous mode.
+int
+logmode(int mode)
+{
+  int old;
+
+  if (mode & ~(LOG_ORDERED|LOG_LAZY))
+    return -1;
+  acquire(&log.lock);
+  old = log.mode;
+  log.mode = mode;
+  if (mode & LOG_LAZY)
+    wakeup(&log.mode);  // log_flusher()
+  release(&log.lock);
+  if ((old & LOG_LAZY) && !(mode & LOG_LAZY))
+    log_sync();
+  return old;
+}
+
+// Use only n of the on-disk log's data blocks, as if the
+// file system had been made with a smaller log, waiting
+// until the open transaction fits; 0 leaves the size alone.
+// Returns the previous size, or -1 if n is out of range.
+int
+logsize(int n)
+{
+  int old;
+
+  if (n != 0 && (n < MAXOPBLOCKS || n > log.max))
+    return -1;
+  acquire(&log.lock);
+  old = log.size;
+  if (n > 0) {
+    while (log.lh.n + log.reserved > n)
+      logwait();
+    log.size = n;
+    // begin_op() may be waiting for a bigger log.
+    wakeup(&log);
+  }
+  release(&log.lock);
+  return old;
+}
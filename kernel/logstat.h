@@ -0,0 +1,15 @@
+#define NLOGHIST 20
+
+// Log modes, for logmode().
+#define LOG_ORDERED 0x1  // log only metadata; write file data in place
+#define LOG_LAZY    0x2  // commit in the background, or at fsync()
+
+// Log statistics, returned by logstat().
+struct logstat {
+  uint64 ncommit;        // Transactions committed
+  uint64 nop;            // System calls in them
+  uint64 nblock;         // Blocks they logged
+  uint64 hist[NLOGHIST]; // Commits taking under 2^(i+1) microseconds,
+                         // and at least 2^i for i > 0; the last
+                         // entry counts all slower ones
+};
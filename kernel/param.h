@@ -1,13 +1,19 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // initial size of i-node cache
+#define INODELIMIT 1000  // max size of i-node cache
+#define NDENTRY     200  // size of directory entry cache
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
-#define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define MAXOPBLOCKS  12  // max # of blocks any FS op writes; see dxlink()
+#define LOGSIZE      (MAXOPBLOCKS*3)  // default size of on-disk log
+#define MAXLOGSIZE   1024  // max data blocks of on-disk log used
+#define NBUF         (LOGSIZE*2+MAXOPBLOCKS)  // initial size of disk block cache
+#define BUFLIMIT     1000  // default max size of disk block cache
+#define FSSIZE       4000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define SLEEPSPIN    10000 // max spins waiting for a running sleeplock holder
+#define LOGFLUSH     3     // ticks between background commits in lazy log mode
@@ -5,19 +5,70 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "sched.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// mask of CPUs that have entered scheduler().
+int cpusonline;
 
 struct proc *initproc;
 
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// The process table is an array of pages of procs, each
+// allocated when first needed and freed again once it is
+// empty, so scans cost in proportion to the pages in use
+// rather than to NPROC. A proc's index in the table (its
+// slot) never changes and fixes the address of its kernel
+// stack, which is mapped only while the slot is in use.
+#define PROCPERPAGE ((int)(PGSIZE / sizeof(struct proc)))
+#define NPROCPAGE ((NPROC + PROCPERPAGE - 1) / PROCPERPAGE)
+
+// Scans of the table hold pointers to procs without holding
+// ptable.lock, so an empty page taken out of the table goes
+// back to kalloc() only after a grace period (see call_rcu()).
+struct {
+  struct spinlock lock;
+  struct proc *page[NPROCPAGE];  // pages of procs, or 0
+  int nfree[NPROCPAGE];          // UNUSED procs in each page
+  int npage;                     // page[i] is 0 for i >= npage
+  struct proc *dead[NPROCPAGE];  // retired pages not yet freed
+  struct rcuhead deadrcu[NPROCPAGE]; // frees dead[i]
+  char deadbusy[NPROCPAGE];      // deadrcu[i] is queued
+} ptable;
+
+// Grace periods, as in RCU.
+//
+// Lock-free readers (process table scans, path lookups in
+// the dentry cache) hold pointers to shared objects that a
+// writer may unlink at any moment, so an unlinked object can
+// only be freed or reused once every reader that might still
+// see it has finished. Readers run with interrupts off (see
+// rcu_read_lock()), so they can't be preempted, and the
+// scheduler holds no such pointer at the top of its loop.
+// Once every online CPU has been through that point (a
+// quiescent state) after the object was unlinked, a grace
+// period has passed and the object is unreachable.
+struct {
+  struct spinlock lock;
+  int done;                      // grace periods completed
+  int wait;                      // CPUs the current one waits for
+  struct rcuhead *pending;       // callbacks, oldest last
+} rcu;
+
+// bumped whenever a kernel stack is mapped or unmapped.
+// each CPU flushes its TLB before running a process if
+// the count has changed since it last did.
+int kstackgen;
+
 extern void forkret(void);
+static void kthreadstart(void);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
+static struct proc *handoff(struct proc *p);
+static void handoffdone(void);
 
 extern char trampoline[]; // trampoline.S
 
@@ -25,23 +76,249 @@ extern char trampoline[]; // trampoline.S
 void
 procinit(void)
 {
-  struct proc *p;
-  
   initlock(&pid_lock, "nextpid");
-  for(p = proc; p < &proc[NPROC]; p++) {
+  initlock(&ptable.lock, "ptable");
+  initlock(&rcu.lock, "rcu");
+
+  // create the page-table pages for every kernel stack
+  // slot now, so mapping a stack never needs to allocate.
+  kvmreserve(KSTACK(NPROC-1), TRAMPOLINE - KSTACK(NPROC-1));
+  kvminithart();
+}
+
+// Return the proc after p in the table, the first if p is 0,
+// or 0 after the last. A scan may run into a page that is
+// being retired, but all its procs are UNUSED and it won't
+// be freed while the scan lasts. Callers other than the
+// scheduler must be in an RCU read-side section (see
+// rcu_read_lock()) for the whole scan.
+static struct proc*
+procnext(struct proc *p)
+{
+  struct proc *pg;
+  int slot;
+
+  for(slot = p ? p->slot + 1 : 0; slot < ptable.npage * PROCPERPAGE; slot++){
+    if((pg = ptable.page[slot / PROCPERPAGE]) == 0){
+      // skip the rest of an absent page.
+      slot += PROCPERPAGE - 1 - slot % PROCPERPAGE;
+      continue;
+    }
+    return &pg[slot % PROCPERPAGE];
+  }
+  return 0;
+}
+
+// the number of usable procs in page i; the last page
+// may extend past NPROC.
+static int
+pageslots(int i)
+{
+  int n = NPROC - i * PROCPERPAGE;
+  return n < PROCPERPAGE ? n : PROCPERPAGE;
+}
+
+// Start a grace period, unless one is already under way.
+// Returns the number of the first grace period to end
+// after every online CPU has passed a quiescent state.
+// Caller must hold rcu.lock.
+static int
+gpstart(void)
+{
+  if(rcu.wait == 0){
+    rcu.wait = cpusonline;
+    return rcu.done + 1;
+  }
+  return rcu.done + 2;
+}
+
+// Begin an RCU read-side section: pointers found by lock-free
+// reads stay valid until the matching rcu_read_unlock().
+// Sections may nest and must not sleep.
+void
+rcu_read_lock(void)
+{
+  push_off();
+}
+
+void
+rcu_read_unlock(void)
+{
+  pop_off();
+}
+
+// Arrange for func(head) to be called once a grace period
+// has passed, by which time no reader can still hold a
+// pointer to an object that was unlinked before the call.
+// func runs in a scheduler thread, with no locks held.
+void
+call_rcu(struct rcuhead *head, void (*func)(struct rcuhead*))
+{
+  acquire(&rcu.lock);
+  head->func = func;
+  head->gp = gpstart();
+  head->next = rcu.pending;
+  rcu.pending = head;
+  release(&rcu.lock);
+}
+
+// Called by CPU id's scheduler at the top of its loop, where
+// it holds no pointers found by lock-free reads: ends the
+// current grace period if this was the last CPU it was
+// waiting for, and runs the callbacks that were waiting for it.
+static void
+rcu_quiescent(int id)
+{
+  struct rcuhead *h, **hp, *done;
+
+  if((rcu.wait & (1 << id)) == 0)
+    return;
+
+  done = 0;
+  acquire(&rcu.lock);
+  rcu.wait &= ~(1 << id);
+  if(rcu.wait == 0){
+    rcu.done++;
+    for(hp = &rcu.pending; (h = *hp) != 0; ){
+      if(h->gp <= rcu.done){
+        *hp = h->next;
+        h->next = done;
+        done = h;
+      } else {
+        hp = &h->next;
+      }
+    }
+    if(rcu.pending)
+      gpstart();
+  }
+  release(&rcu.lock);
+
+  while((h = done) != 0){
+    done = h->next;
+    h->func(h);
+  }
+}
+
+// Put page i into the table, reviving it if it was retired
+// but not yet freed, or else allocating it.
+// Caller must hold ptable.lock.
+static int
+addpage(int i)
+{
+  struct proc *pg, *p;
+  int j;
+
+  if((pg = ptable.dead[i]) != 0){
+    // every proc in it is still UNUSED and initialized.
+    ptable.dead[i] = 0;
+  } else {
+    if((pg = (struct proc*)kalloc()) == 0)
+      return -1;
+    memset(pg, 0, PGSIZE);
+    for(j = 0; j < PROCPERPAGE; j++){
+      p = &pg[j];
       initlock(&p->lock, "proc");
+      p->slot = i * PROCPERPAGE + j;
+      p->kstack = KSTACK(p->slot);
+      p->lastcpu = -1;
+    }
+    // scans read the page without ptable.lock.
+    __sync_synchronize();
+  }
+  ptable.page[i] = pg;
+  ptable.nfree[i] = pageslots(i);
+  if(i >= ptable.npage)
+    ptable.npage = i + 1;
+  return 0;
+}
 
-      // Allocate a page for the process's kernel stack.
-      // Map it high in memory, followed by an invalid
-      // guard page.
-      char *pa = kalloc();
-      if(pa == 0)
-        panic("kalloc");
-      uint64 va = KSTACK((int) (p - proc));
-      kvmmap(va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-      p->kstack = va;
+// Free page i once it has been retired for a grace period,
+// unless it has been revived since.
+static void
+freedeadpage(struct rcuhead *head)
+{
+  int i = head - ptable.deadrcu;
+
+  acquire(&ptable.lock);
+  ptable.deadbusy[i] = 0;
+  if(ptable.dead[i]){
+    kfree((void*)ptable.dead[i]);
+    ptable.dead[i] = 0;
   }
-  kvminithart();
+  release(&ptable.lock);
+}
+
+// Take empty page i out of the table, to be freed after
+// a grace period. Caller must hold ptable.lock.
+static void
+retirepage(int i)
+{
+  ptable.dead[i] = ptable.page[i];
+  ptable.deadbusy[i] = 1;
+  call_rcu(&ptable.deadrcu[i], freedeadpage);
+  ptable.page[i] = 0;
+  while(ptable.npage > 0 && ptable.page[ptable.npage-1] == 0)
+    ptable.npage--;
+}
+
+// Claim an UNUSED proc by marking it USED, from the lowest
+// page that has one, adding a page if none does.
+static struct proc*
+allocslot(void)
+{
+  struct proc *p;
+  int i, j;
+
+  acquire(&ptable.lock);
+  for(i = 0; i < ptable.npage; i++)
+    if(ptable.page[i] && ptable.nfree[i] > 0)
+      break;
+  if(i == ptable.npage){
+    for(i = 0; i < NPROCPAGE; i++)
+      if(ptable.page[i] == 0)
+        break;
+    if(i == NPROCPAGE || addpage(i) < 0){
+      release(&ptable.lock);
+      return 0;
+    }
+  }
+
+  for(j = 0; j < pageslots(i); j++){
+    p = &ptable.page[i][j];
+    if(p->state == UNUSED){
+      // state only enters or leaves UNUSED under
+      // ptable.lock, so p->lock isn't needed here.
+      p->state = USED;
+      ptable.nfree[i]--;
+      release(&ptable.lock);
+      return p;
+    }
+  }
+  panic("allocslot");
+}
+
+// Give p's slot back, and retire its page if that leaves
+// the page empty while another page still has room (and
+// the page's slot isn't still waiting to free an older one).
+// Caller must hold p->lock.
+static void
+freeslot(struct proc *p)
+{
+  int i, j;
+
+  acquire(&ptable.lock);
+  p->state = UNUSED;
+  i = p->slot / PROCPERPAGE;
+  ptable.nfree[i]++;
+  if(ptable.nfree[i] == pageslots(i) && !ptable.deadbusy[i]){
+    for(j = 0; j < ptable.npage; j++){
+      if(j != i && ptable.page[j] && ptable.nfree[j] > 0){
+        retirepage(i);
+        break;
+      }
+    }
+  }
+  release(&ptable.lock);
 }
 
 // Must be called with interrupts disabled,
@@ -85,7 +362,7 @@ allocpid() {
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
+// Claim an UNUSED proc from the process table.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
 // If there are no free procs, or a memory allocation fails, return 0.
@@ -94,21 +371,30 @@ allocproc(void)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
-  }
-  return 0;
+  if((p = allocslot()) == 0)
+    return 0;
 
-found:
+  acquire(&p->lock);
   p->pid = allocpid();
+  p->affinity = ALLCPUS;
+  p->lastcpu = -1;
+  p->migrations = 0;
+  p->nswitch = 0;
+  p->handoffslot = -1;
+
+  // Allocate a page for the process's kernel stack.
+  // Map it high in memory, followed by an invalid
+  // guard page.
+  if(kvmmapstack(p->kstack) < 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  __sync_fetch_and_add(&kstackgen, 1);
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+    freeproc(p);
     release(&p->lock);
     return 0;
   }
@@ -145,11 +431,17 @@ freeproc(struct proc *p)
   p->sz = 0;
   p->pid = 0;
   p->parent = 0;
+  p->children = 0;
+  p->sibling = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
-  p->state = UNUSED;
+  p->affinity = 0;
+  p->lastcpu = -1;
+  kvmunmapstack(p->kstack);
+  __sync_fetch_and_add(&kstackgen, 1);
+  freeslot(p);
 }
 
 // Create a user page table for a given process,
@@ -233,6 +525,34 @@ userinit(void)
   release(&p->lock);
 }
 
+// Start a kernel thread: a process that runs fn() in the
+// kernel and never returns to user space. fn must not return.
+void
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread");
+  p->context.ra = (uint64)kthreadstart;
+  p->kthread = fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadstart.
+static void
+kthreadstart(void)
+{
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+
+  myproc()->kthread();
+  panic("kthread returned");
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -291,38 +611,46 @@ fork(void)
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
+  np->affinity = p->affinity;
+
   pid = np->pid;
 
-  np->state = RUNNABLE;
+  release(&np->lock);
 
+  // add np to our list of children. p->lock protects the list,
+  // and must not be acquired while holding np->lock.
+  acquire(&p->lock);
+  np->sibling = p->children;
+  p->children = np;
+  release(&p->lock);
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
   release(&np->lock);
 
   return pid;
 }
 
 // Pass p's abandoned children to init.
-// Caller must hold p->lock.
+// Caller must hold initproc->lock and p->lock.
 void
 reparent(struct proc *p)
 {
-  struct proc *pp;
-
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    // this code uses pp->parent without holding pp->lock.
-    // acquiring the lock first could cause a deadlock
-    // if pp or a child of pp were also in exit()
-    // and about to try to lock p.
-    if(pp->parent == p){
-      // pp->parent can't change between the check and the acquire()
-      // because only the parent changes it, and we're the parent.
-      acquire(&pp->lock);
-      pp->parent = initproc;
-      // we should wake up init here, but that would require
-      // initproc->lock, which would be a deadlock, since we hold
-      // the lock on one of init's children (pp). this is why
-      // exit() always wakes init (before acquiring any locks).
-      release(&pp->lock);
-    }
+  struct proc *pp, *last;
+
+  last = 0;
+  for(pp = p->children; pp; pp = pp->sibling){
+    acquire(&pp->lock);
+    pp->parent = initproc;
+    release(&pp->lock);
+    last = pp;
+  }
+
+  // splice the whole list onto the front of init's.
+  if(last){
+    last->sibling = initproc->children;
+    initproc->children = p->children;
+    p->children = 0;
   }
 }
 
@@ -351,13 +679,17 @@ exit(int status)
   end_op();
   p->cwd = 0;
 
-  // we might re-parent a child to init. we can't be precise about
-  // waking up init, since we can't acquire its lock once we've
-  // acquired any other proc lock. so wake up init whether that's
-  // necessary or not. init may miss this wakeup, but that seems
-  // harmless.
+  // Give any children to init. init is an ancestor of every
+  // process, so locking it before p follows the parent-then-child
+  // rule. p can't gain children once it is exiting.
   acquire(&initproc->lock);
-  wakeup1(initproc);
+  acquire(&p->lock);
+  if(p->children){
+    reparent(p);
+    // one of them may already be a zombie.
+    wakeup1(initproc);
+  }
+  release(&p->lock);
   release(&initproc->lock);
 
   // grab a copy of p->parent, to ensure that we unlock the same
@@ -365,7 +697,10 @@ exit(int status)
   // we're waiting for the parent lock. we may then race with an
   // exiting parent, but the result will be a harmless spurious wakeup
   // to a dead or wrong process; proc structs are never re-allocated
-  // as anything else.
+  // as anything else. an RCU read-side section lasts until we hold
+  // the parent's lock, so that its page of the process table can't
+  // be freed in between.
+  rcu_read_lock();
   acquire(&p->lock);
   struct proc *original_parent = p->parent;
   release(&p->lock);
@@ -373,12 +708,10 @@ exit(int status)
   // we need the parent's lock in order to wake it up from wait().
   // the parent-then-child rule says we have to lock it first.
   acquire(&original_parent->lock);
+  rcu_read_unlock();
 
   acquire(&p->lock);
 
-  // Give any children to init.
-  reparent(p);
-
   // Parent might be sleeping in wait().
   wakeup1(original_parent);
 
@@ -397,46 +730,39 @@ exit(int status)
 int
 wait(uint64 addr)
 {
-  struct proc *np;
-  int havekids, pid;
+  struct proc *np, **pp;
+  int pid;
   struct proc *p = myproc();
 
   // hold p->lock for the whole time to avoid lost
-  // wakeups from a child's exit().
+  // wakeups from a child's exit(). it also protects
+  // p's list of children.
   acquire(&p->lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      // this code uses np->parent without holding np->lock.
-      // acquiring the lock first would cause a deadlock,
-      // since np might be an ancestor, and we already hold p->lock.
-      if(np->parent == p){
-        // np->parent can't change between the check and the acquire()
-        // because only the parent changes it, and we're the parent.
-        acquire(&np->lock);
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&p->lock);
-            return -1;
-          }
-          freeproc(np);
+    // Scan through our children looking for exited ones.
+    for(pp = &p->children; (np = *pp) != 0; pp = &np->sibling){
+      acquire(&np->lock);
+      if(np->state == ZOMBIE){
+        // Found one.
+        pid = np->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                                sizeof(np->xstate)) < 0) {
           release(&np->lock);
           release(&p->lock);
-          return pid;
+          return -1;
         }
+        *pp = np->sibling;
+        freeproc(np);
         release(&np->lock);
+        release(&p->lock);
+        return pid;
       }
+      release(&np->lock);
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || p->killed){
+    if(p->children == 0 || p->killed){
       release(&p->lock);
       return -1;
     }
@@ -446,6 +772,26 @@ wait(uint64 addr)
   }
 }
 
+// Make p, which must be RUNNABLE and locked, the process
+// running on CPU c.
+static void
+switchin(struct cpu *c, struct proc *p)
+{
+  int id = c - cpus;
+
+  p->state = RUNNING;
+  c->proc = p;
+  if(p->lastcpu >= 0 && p->lastcpu != id)
+    p->migrations++;
+  p->lastcpu = id;
+  p->nswitch++;
+  if(c->kstackgen != kstackgen){
+    // a kernel stack may have moved since our last flush.
+    c->kstackgen = kstackgen;
+    sfence_vma();
+  }
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -453,38 +799,53 @@ wait(uint64 addr)
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
+// A CPU first runs the processes that last ran on it, whose
+// working sets are likely still in its caches, and only
+// takes processes that last ran elsewhere when it has none
+// of its own. A process is never run on a CPU outside its
+// affinity mask.
 void
 scheduler(void)
 {
-  struct proc *p;
+  struct proc *p, *np;
   struct cpu *c = mycpu();
+  int id = cpuid();
   
   c->proc = 0;
+  __sync_fetch_and_or(&cpusonline, 1 << id);
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
+
+    rcu_quiescent(id);
     
-    int nproc = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state != UNUSED) {
-        nproc++;
-      }
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
+    int ran = 0;
+    for(int pass = 0; pass < 2 && !ran; pass++){
+      for(p = procnext(0); p; p = procnext(p)) {
+        acquire(&p->lock);
+        if(p->state == RUNNABLE && (p->affinity & (1 << id)) &&
+           (pass == 1 || p->lastcpu == id || p->lastcpu < 0)) {
+          // Switch to chosen process.  It is the process's job
+          // to release its lock and then reacquire it
+          // before jumping back to us.
+          switchin(c, p);
+          swtch(&c->context, &p->context);
+
+          // Process is done running for now.
+          // It should have changed its p->state before coming back.
+          // It may not be p: p may have handed the CPU straight
+          // to another process (see sched()), whose lock we
+          // hold now instead.
+          np = c->proc;
+          c->proc = 0;
+          ran = 1;
+          release(&np->lock);
+          continue;
+        }
+        release(&p->lock);
       }
-      release(&p->lock);
     }
-    if(nproc <= 2) {   // only init and sh exist
+    if(!ran) {   // nothing to run: wait for an interrupt
       intr_on();
       asm volatile("wfi");
     }
@@ -503,6 +864,7 @@ sched(void)
 {
   int intena;
   struct proc *p = myproc();
+  struct proc *np;
 
   if(!holding(&p->lock))
     panic("sched p->lock");
@@ -514,10 +876,67 @@ sched(void)
     panic("sched interruptible");
 
   intena = mycpu()->intena;
-  swtch(&p->context, &mycpu()->context);
+  if((np = handoff(p)) != 0)
+    swtch(&p->context, &np->context);
+  else
+    swtch(&p->context, &mycpu()->context);
+  handoffdone();
   mycpu()->intena = intena;
 }
 
+// If p is about to sleep in sleep_handoff() and has just
+// woken a process that is still waiting to run here (see
+// wakeup_handoff()), switch that process in on this CPU, so
+// that sched() can swtch straight to it instead of going
+// through scheduler(). Returns the process, locked, or 0.
+// The woken process may already be running elsewhere and
+// holding its own lock while it waits for p's, as wait()
+// does for its children, so p mustn't wait for np's lock
+// while holding its own; it gives up on the handoff instead.
+static struct proc*
+handoff(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  struct proc *np;
+  int slot = p->handoffslot;
+
+  p->handoffslot = -1;
+  if(slot < 0 || p->state != SLEEPING)
+    return 0;
+
+  // a page that holds procs is never freed while this CPU
+  // has interrupts off, as it does here.
+  if((np = ptable.page[slot / PROCPERPAGE]) == 0)
+    return 0;
+  np = &np[slot % PROCPERPAGE];
+  if(!tryacquire(&np->lock))
+    return 0;
+  if(np->state != RUNNABLE || np->pid != p->handoffpid ||
+     (np->affinity & (1 << cpuid())) == 0){
+    release(&np->lock);
+    return 0;
+  }
+  switchin(c, np);
+  // np releases p->lock when it resumes, in handoffdone().
+  c->handoffprev = p;
+  return np;
+}
+
+// Called by a process as it resumes in sched(): if the
+// previous process on this CPU handed off to it directly,
+// release that process's lock, as scheduler() would have.
+static void
+handoffdone(void)
+{
+  struct cpu *c = mycpu();
+  struct proc *prev = c->handoffprev;
+
+  if(prev){
+    c->handoffprev = 0;
+    release(&prev->lock);
+  }
+}
+
 // Give up the CPU for one scheduling round.
 void
 yield(void)
@@ -550,10 +969,12 @@ forkret(void)
   usertrapret();
 }
 
-// Atomically release lock and sleep on chan.
+// Atomically release lock and sleep on chan, handing the
+// CPU to the process the caller last woke with
+// wakeup_handoff() if handoff is set.
 // Reacquires lock when awakened.
-void
-sleep(void *chan, struct spinlock *lk)
+static void
+sleep1(void *chan, struct spinlock *lk, int handoff)
 {
   struct proc *p = myproc();
   
@@ -571,6 +992,8 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  if(!handoff)
+    p->handoffslot = -1;
 
   sched();
 
@@ -584,20 +1007,75 @@ sleep(void *chan, struct spinlock *lk)
   }
 }
 
-// Wake up all processes sleeping on chan.
-// Must be called without any p->lock.
+// Atomically release lock and sleep on chan.
+// Reacquires lock when awakened.
 void
-wakeup(void *chan)
+sleep(void *chan, struct spinlock *lk)
+{
+  sleep1(chan, lk, 0);
+}
+
+// Like sleep(), but if the caller has just woken a process
+// with wakeup_handoff(), switch straight to it.
+void
+sleep_handoff(void *chan, struct spinlock *lk)
+{
+  sleep1(chan, lk, 1);
+}
+
+// Wake up at most n processes sleeping on chan, and if
+// waker isn't 0, tell it about the first one woken.
+// Returns the number of processes woken.
+static int
+wakeupchan(void *chan, int n, struct proc *waker)
 {
   struct proc *p;
+  int woken = 0;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  rcu_read_lock();
+  for(p = procnext(0); p && woken < n; p = procnext(p)) {
     acquire(&p->lock);
     if(p->state == SLEEPING && p->chan == chan) {
       p->state = RUNNABLE;
+      if(waker && woken == 0){
+        waker->handoffslot = p->slot;
+        waker->handoffpid = p->pid;
+      }
+      woken++;
     }
     release(&p->lock);
   }
+  rcu_read_unlock();
+  return woken;
+}
+
+// Wake up all processes sleeping on chan.
+// Must be called without any p->lock.
+void
+wakeup(void *chan)
+{
+  wakeupchan(chan, NPROC, 0);
+}
+
+// Wake up at most n processes sleeping on chan.
+// Returns the number of processes woken.
+// Must be called without any p->lock.
+int
+wakeupn(void *chan, int n)
+{
+  return wakeupchan(chan, n, 0);
+}
+
+// Like wakeup(), but if the caller next gives up the CPU in
+// sleep_handoff(), switch directly to the first process
+// woken, if it hasn't run yet, rather than going through
+// the scheduler. Meant for synchronous IPC,
+// where the waker usually waits for a reply right away.
+// Must be called without any p->lock.
+void
+wakeup_handoff(void *chan)
+{
+  wakeupchan(chan, NPROC, myproc());
 }
 
 // Wake up p if it is sleeping in wait(); used by exit().
@@ -620,7 +1098,8 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
+  rcu_read_lock();
+  for(p = procnext(0); p; p = procnext(p)){
     acquire(&p->lock);
     if(p->pid == pid){
       p->killed = 1;
@@ -629,10 +1108,65 @@ kill(int pid)
         p->state = RUNNABLE;
       }
       release(&p->lock);
+      rcu_read_unlock();
       return 0;
     }
     release(&p->lock);
   }
+  rcu_read_unlock();
+  return -1;
+}
+
+// Restrict the current process to the CPUs in mask.
+// Returns -1 if mask contains no CPU that is running.
+int
+setaffinity(int mask)
+{
+  struct proc *p = myproc();
+
+  mask &= ALLCPUS;
+  if((mask & cpusonline) == 0)
+    return -1;
+
+  acquire(&p->lock);
+  p->affinity = mask;
+  // a lastcpu outside the mask would keep p off every CPU's
+  // preferred list.
+  if(p->lastcpu >= 0 && (mask & (1 << p->lastcpu)) == 0)
+    p->lastcpu = -1;
+  release(&p->lock);
+
+  // move to an allowed CPU now if this one isn't.
+  if((mask & (1 << cpuid())) == 0)
+    yield();
+  return 0;
+}
+
+// Copy scheduling information about process pid
+// (or the current process, if pid is 0) to user address addr.
+int
+schedstat(int pid, uint64 addr)
+{
+  struct proc *p;
+  struct schedstat st;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  rcu_read_lock();
+  for(p = procnext(0); p; p = procnext(p)){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      st.affinity = p->affinity;
+      st.lastcpu = p->lastcpu;
+      st.migrations = p->migrations;
+      st.nswitch = p->nswitch;
+      release(&p->lock);
+      rcu_read_unlock();
+      return copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st));
+    }
+    release(&p->lock);
+  }
+  rcu_read_unlock();
   return -1;
 }
 
@@ -674,6 +1208,7 @@ procdump(void)
 {
   static char *states[] = {
   [UNUSED]    "unused",
+  [USED]      "used  ",
   [SLEEPING]  "sleep ",
   [RUNNABLE]  "runble",
   [RUNNING]   "run   ",
@@ -683,14 +1218,15 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(p = procnext(0); p; p = procnext(p)){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
       state = states[p->state];
     else
       state = "???";
-    printf("%d %s %s", p->pid, state, p->name);
+    printf("%d %s %s cpu %d mig %d", p->pid, state, p->name,
+           p->lastcpu, p->migrations);
     printf("\n");
   }
 }
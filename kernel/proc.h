@@ -24,10 +24,15 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int kstackgen;              // kstackgen at this CPU's last TLB flush
+  struct proc *handoffprev;   // Process that handed off to c->proc, still locked
 };
 
 extern struct cpu cpus[NCPU];
 
+// affinity mask allowing every CPU.
+#define ALLCPUS ((1 << NCPU) - 1)
+
 // per-process data for the trap handling code in trampoline.S.
 // sits in a page by itself just under the trampoline page in the
 // user page table. not specially mapped in the kernel page table.
@@ -80,7 +85,14 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
-enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
+// Deferred work to do after a grace period; see call_rcu().
+struct rcuhead {
+  struct rcuhead *next;
+  int gp;                          // Grace period to wait for
+  void (*func)(struct rcuhead*);
+};
+
+enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
@@ -89,12 +101,19 @@ struct proc {
   // p->lock must be held when using these:
   enum procstate state;        // Process state
   struct proc *parent;         // Parent process
+  struct proc *children;       // Children, linked through sibling
+  struct proc *sibling;        // Next child of parent (parent->lock)
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int affinity;                // Mask of CPUs p may run on
+  int lastcpu;                 // CPU p last ran on, or -1
+  int migrations;              // Times p resumed on a different CPU
+  int nswitch;                 // Times p has been scheduled
 
   // these are private to the process, so p->lock need not be held.
+  int slot;                    // Index in the process table
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
@@ -103,4 +122,7 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  int handoffslot;             // Slot of a process to switch to if p blocks, or -1
+  int handoffpid;              // and its pid
+  void (*kthread)(void);       // Kernel thread's function; see kthread()
 };
@@ -331,6 +331,7 @@ sfence_vma()
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
+#define PTE_SHARED (1L << 8) // 1 -> shared with children across fork()
 #define PTE_COW (1L << 9) // 1 -> copy-on-write page
 
 // shift a physical address to the right place for a PTE.
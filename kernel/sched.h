@@ -0,0 +1,7 @@
+// Scheduling information about a process, returned by schedstat().
+struct schedstat {
+  int affinity;    // Mask of CPUs the process may run on
+  int lastcpu;     // CPU it last ran on, or -1
+  int migrations;  // Times it resumed on a different CPU
+  int nswitch;     // Times it has been scheduled
+};
@@ -15,17 +15,73 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->owner = 0;
+  lk->readers = 0;
+  lk->xwait = 0;
+  lk->nsleep = 0;
   lk->pid = 0;
 }
 
+// Spin while lk stays held by the same process and that
+// process keeps running (on another CPU), for at most n
+// iterations. Called and returns with lk->lk held, but
+// releases it while spinning. Returns the iterations used.
+static int
+spinwait(struct sleeplock *lk, int n)
+{
+  struct proc *owner = lk->owner;
+  int i;
+
+  // stay in an RCU read-side section until lk->lk is held
+  // again, so that owner's proc can't be freed while we
+  // look at it without holding any lock.
+  rcu_read_lock();
+  release(&lk->lk);
+  for(i = 0; i < n; i++){
+    if(*(volatile uint*)&lk->locked == 0 ||
+       *(struct proc *volatile*)&lk->owner != owner ||
+       *(volatile enum procstate*)&owner->state != RUNNING)
+      break;
+  }
+  acquire(&lk->lk);
+  rcu_read_unlock();
+  return i + 1;
+}
+
+// Wait for lk to change, by spinning if an exclusive holder
+// is running (see acquiresleep()) and *spins allows, or else
+// by sleeping. Caller must hold lk->lk.
+static void
+waitsleep(struct sleeplock *lk, int *spins)
+{
+  if(*spins < SLEEPSPIN && lk->owner && lk->owner->state == RUNNING){
+    *spins += spinwait(lk, SLEEPSPIN - *spins);
+    return;
+  }
+  lk->nsleep++;
+  sleep(lk, &lk->lk);
+  lk->nsleep--;
+}
+
+// Acquire the lock exclusively. A holder running on another
+// CPU is likely to release it within microseconds (buffer
+// and inode locks are mostly held briefly), much sooner than
+// a sleep and wakeup would take, so wait by spinning for up
+// to SLEEPSPIN iterations while it runs, and sleep only
+// otherwise.
 void
 acquiresleep(struct sleeplock *lk)
 {
+  int spins = 0;
+
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  lk->xwait++;
+  while (lk->locked || lk->readers) {
+    waitsleep(lk, &spins);
   }
+  lk->xwait--;
   lk->locked = 1;
+  lk->owner = myproc();
   lk->pid = myproc()->pid;
   release(&lk->lk);
 }
@@ -35,20 +91,80 @@ releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
   lk->locked = 0;
+  lk->owner = 0;
   lk->pid = 0;
-  wakeup(lk);
+  if(lk->nsleep)
+    wakeup(lk);
   release(&lk->lk);
 }
 
-int
-holdingsleep(struct sleeplock *lk)
+// Keep lk held but no longer owned by the caller, for a lock
+// that something else, such as an interrupt handler, will
+// release. Waiters sleep rather than spin on it.
+void
+disownsleep(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  lk->owner = 0;
+  lk->pid = 0;
+  release(&lk->lk);
+}
+
+// Acquire the lock shared with other readers. New readers
+// wait while a writer is waiting, so writers can't starve.
+void
+acquiresleep_shared(struct sleeplock *lk)
 {
-  int r;
-  
+  int spins = 0;
+
   acquire(&lk->lk);
-  r = lk->locked && (lk->pid == myproc()->pid);
+  while (lk->locked || lk->xwait) {
+    waitsleep(lk, &spins);
+  }
+  lk->readers++;
   release(&lk->lk);
-  return r;
+}
+
+void
+releasesleep_shared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->readers < 1)
+    panic("releasesleep_shared");
+  lk->readers--;
+  if(lk->readers == 0 && lk->nsleep)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
+// Turn the caller's exclusive hold on lk into a shared one,
+// letting waiting readers in.
+void
+downgradesleep(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  lk->locked = 0;
+  lk->owner = 0;
+  lk->pid = 0;
+  lk->readers++;
+  if(lk->nsleep)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
+// Is lk held shared by anyone? (Readers aren't recorded.)
+int
+holdingsleep_shared(struct sleeplock *lk)
+{
+  return lk->readers > 0;
+}
+
+// Only the holder ever sets owner to itself, and it clears
+// owner before releasing, so the check needs no lock.
+int
+holdingsleep(struct sleeplock *lk)
+{
+  return lk->locked && lk->owner == myproc();
 }
 
 
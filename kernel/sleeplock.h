@@ -1,7 +1,13 @@
-// Long-term locks for processes
+// Long-term locks for processes.
+// Held either exclusively by one process (acquiresleep())
+// or shared by any number of readers (acquiresleep_shared()).
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
   struct spinlock lk; // spinlock protecting this sleep lock
+  struct proc *owner; // Process holding lock exclusively, or 0
+  int readers;       // Processes holding lock shared
+  int xwait;         // Processes waiting to hold lock exclusively
+  int nsleep;        // Processes sleeping on the lock
   
   // For debugging:
   char *name;        // Name of lock.
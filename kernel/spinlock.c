@@ -7,13 +7,65 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "lockstat.h"
+
+// Contention statistics are kept per lock class, the locks
+// that share a name (such as all the "proc" locks), so that
+// locks that come and go, like those of pipes and procs,
+// needn't be registered and unregistered. Each CPU counts in
+// its own row, with interrupts off, so counting needs no
+// atomic instructions and no shared cache lines.
+#define NLOCKCLASS 64
+
+struct lockcount {
+  uint64 nacquire;
+  uint64 ncontended;
+  uint64 nspin;
+};
+
+static struct lockcount lockcount[NCPU][NLOCKCLASS];
+static char *classname[NLOCKCLASS];
+static int nclass;
+static uint classlock;   // protects classname[] and nclass
+
+// Return the statistics index for locks named name. Classes
+// past the table's capacity share the last entry.
+static int
+lockclass(char *name)
+{
+  int i;
+
+  push_off();
+  while(__sync_lock_test_and_set(&classlock, 1) != 0)
+    ;
+  __sync_synchronize();
+
+  for(i = 0; i < nclass; i++)
+    if(strncmp(classname[i], name, sizeof(((struct lockstat*)0)->name)) == 0)
+      break;
+  if(i == nclass){
+    if(nclass < NLOCKCLASS-1){
+      classname[nclass++] = name;
+    } else {
+      i = NLOCKCLASS-1;
+      classname[i] = "(other)";
+    }
+  }
+
+  __sync_synchronize();
+  __sync_lock_release(&classlock);
+  pop_off();
+  return i;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->class = lockclass(name);
 }
 
 // Acquire the lock.
@@ -21,16 +73,25 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+  uint64 spins = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
+  // Take a ticket. On RISC-V, sync_fetch_and_add turns into
+  // an atomic add:
   //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  //   s1 = &lk->next
+  //   amoadd.w.aqrl a4, a5, (s1)
+  ticket = __sync_fetch_and_add(&lk->next, 1);
+
+  // Wait for our turn. Waiters only read owner, so they
+  // don't pull its cache line away from the holder until
+  // it releases the lock.
+  while(*(volatile uint *)&lk->owner != ticket)
+    spins++;
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +101,13 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  struct lockcount *lc = &lockcount[cpuid()][lk->class];
+  lc->nacquire++;
+  if(spins){
+    lc->ncontended++;
+    lc->nspin += spins;
+  }
 }
 
 // Release the lock.
@@ -59,28 +127,80 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
+  // Serve the next ticket, equivalent to lk->owner++.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
   // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  __sync_fetch_and_add(&lk->owner, 1);
 
   pop_off();
 }
 
+// Acquire the lock if no one holds it or is waiting for
+// it, without spinning. Returns 1 if it did, else 0.
+int
+tryacquire(struct spinlock *lk)
+{
+  uint ticket;
+
+  push_off();
+  if(holding(lk))
+    panic("tryacquire");
+
+  // the lock is free when the next ticket is the one being
+  // served; take that ticket only if it still is.
+  ticket = *(volatile uint *)&lk->owner;
+  if(!__sync_bool_compare_and_swap(&lk->next, ticket, ticket + 1)){
+    pop_off();
+    return 0;
+  }
+  __sync_synchronize();
+
+  lk->cpu = mycpu();
+  lockcount[cpuid()][lk->class].nacquire++;
+  return 1;
+}
+
 // Check whether this cpu is holding the lock.
 // Interrupts must be off.
 int
 holding(struct spinlock *lk)
 {
   int r;
-  r = (lk->locked && lk->cpu == mycpu());
+  r = (lk->owner != lk->next && lk->cpu == mycpu());
   return r;
 }
 
+// Copy the statistics of up to max lock classes to user
+// address addr, an array of struct lockstat, and then
+// clear all the counters if reset is set.
+// Returns the number of classes copied.
+int
+lockstat(uint64 addr, int max, int reset)
+{
+  struct lockstat st;
+  int i, id, n;
+
+  // once the table fills, the overflow entry follows the rest.
+  n = nclass + (classname[NLOCKCLASS-1] != 0);
+  if(n > max)
+    n = max;
+  for(i = 0; i < n; i++){
+    memset(&st, 0, sizeof(st));
+    safestrcpy(st.name, classname[i], sizeof(st.name));
+    for(id = 0; id < NCPU; id++){
+      st.nacquire += lockcount[id][i].nacquire;
+      st.ncontended += lockcount[id][i].ncontended;
+      st.nspin += lockcount[id][i].nspin;
+    }
+    if(copyout(myproc()->pagetable, addr + i*sizeof(st), (char *)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  if(reset)
+    memset(lockcount, 0, sizeof(lockcount));
+  return n;
+}
+
 // push_off/pop_off are like intr_off()/intr_on() except that they are matched:
 // it takes two pop_off()s to undo two push_off()s.  Also, if interrupts
 // are initially off, then push_off, pop_off leaves them off.
@@ -104,6 +104,20 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_mshare(void);
+extern uint64 sys_setaffinity(void);
+extern uint64 sys_schedstat(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_bcachestat(void);
+extern uint64 sys_bcachelimit(void);
+extern uint64 sys_diskstat(void);
+extern uint64 sys_logstat(void);
+extern uint64 sys_logmode(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_logsize(void);
+extern uint64 sys_dcachestat(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,6 +141,20 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_mshare]  sys_mshare,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_schedstat] sys_schedstat,
+[SYS_lockstat] sys_lockstat,
+[SYS_bcachestat] sys_bcachestat,
+[SYS_bcachelimit] sys_bcachelimit,
+[SYS_diskstat] sys_diskstat,
+[SYS_logstat] sys_logstat,
+[SYS_logmode] sys_logmode,
+[SYS_fsync]   sys_fsync,
+[SYS_logsize] sys_logsize,
+[SYS_dcachestat] sys_dcachestat,
 };
 
 void
@@ -20,3 +20,17 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_futex_wait 22
+#define SYS_futex_wake 23
+#define SYS_mshare 24
+#define SYS_setaffinity 25
+#define SYS_schedstat 26
+#define SYS_lockstat 27
+#define SYS_bcachestat 28
+#define SYS_bcachelimit 29
+#define SYS_diskstat 30
+#define SYS_logstat 31
+#define SYS_logmode 32
+#define SYS_fsync 33
+#define SYS_logsize 34
+#define SYS_dcachestat 35
@@ -215,6 +215,7 @@ sys_unlink(void)
     goto bad;
   }
 
+  dcache_remove(dp->dev, dp->inum, name);
   memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
@@ -275,8 +276,19 @@ create(char *path, short type, short major, short minor)
       panic("create dots");
   }
 
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+  if(dirlink(dp, name, ip->inum) < 0){
+    // an indexed directory may have no room for name's
+    // hash; free the new inode again.
+    if(type == T_DIR){
+      dp->nlink--;
+      iupdate(dp);
+    }
+    ip->nlink = 0;
+    iupdate(ip);
+    iunlockput(ip);
+    iunlockput(dp);
+    return 0;
+  }
 
   iunlockput(dp);
 
@@ -336,6 +348,9 @@ sys_open(void)
   } else {
     f->type = FD_INODE;
     f->off = 0;
+    f->rapos = 0;
+    f->ranext = 0;
+    f->rawin = 0;
   }
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
@@ -484,3 +499,88 @@ sys_pipe(void)
   }
   return 0;
 }
+
+uint64
+sys_bcachestat(void)
+{
+  uint64 st; // user pointer to struct bcachestat
+  int reset;
+
+  if(argaddr(0, &st) < 0 || argint(1, &reset) < 0)
+    return -1;
+  return bcachestat(st, reset);
+}
+
+uint64
+sys_bcachelimit(void)
+{
+  int limit;
+
+  if(argint(0, &limit) < 0)
+    return -1;
+  return bcachelimit(limit);
+}
+
+uint64
+sys_diskstat(void)
+{
+  uint64 st; // user pointer to struct diskstat
+  int reset;
+
+  if(argaddr(0, &st) < 0 || argint(1, &reset) < 0)
+    return -1;
+  return virtio_disk_stat(st, reset);
+}
+
+uint64
+sys_logstat(void)
+{
+  uint64 st; // user pointer to struct logstat
+  int reset;
+
+  if(argaddr(0, &st) < 0 || argint(1, &reset) < 0)
+    return -1;
+  return logstat(st, reset);
+}
+
+uint64
+sys_logmode(void)
+{
+  int mode;
+
+  if(argint(0, &mode) < 0)
+    return -1;
+  return logmode(mode);
+}
+
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  log_sync();
+  return 0;
+}
+
+uint64
+sys_logsize(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return logsize(n);
+}
+
+uint64
+sys_dcachestat(void)
+{
+  uint64 st; // user pointer to struct dcachestat
+  int reset;
+
+  if(argaddr(0, &st) < 0 || argint(1, &reset) < 0)
+    return -1;
+  return dcachestat(st, reset);
+}
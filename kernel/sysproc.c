@@ -95,3 +95,73 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+uint64
+sys_futex_wait(void)
+{
+  uint64 addr;
+  int val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait(addr, val);
+}
+
+uint64
+sys_futex_wake(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake(addr, n);
+}
+
+// share [addr, addr+n) with children created by later fork()s,
+// instead of giving them copy-on-write copies.
+uint64
+sys_mshare(void)
+{
+  uint64 addr;
+  int n;
+  struct proc *p = myproc();
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  if(addr % PGSIZE != 0 || n <= 0 || addr + n > p->sz || addr + n < addr)
+    return -1;
+  return uvmshare(p->pagetable, addr, PGROUNDUP(n) / PGSIZE);
+}
+
+uint64
+sys_setaffinity(void)
+{
+  int mask;
+
+  if(argint(0, &mask) < 0)
+    return -1;
+  return setaffinity(mask);
+}
+
+uint64
+sys_schedstat(void)
+{
+  int pid;
+  uint64 st; // user pointer to struct schedstat
+
+  if(argint(0, &pid) < 0 || argaddr(1, &st) < 0)
+    return -1;
+  return schedstat(pid, st);
+}
+
+uint64
+sys_lockstat(void)
+{
+  uint64 st; // user pointer to array of struct lockstat
+  int max, reset;
+
+  if(argaddr(0, &st) < 0 || argint(1, &max) < 0 || argint(2, &reset) < 0)
+    return -1;
+  return lockstat(st, max, reset);
+}
@@ -16,10 +16,21 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "diskstat.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
+// most blocks merged into one request.
+#define MAXSEG 16
+
+// the first descriptor of a request points to one of these.
+struct virtio_blk_outhdr {
+  uint32 type;
+  uint32 reserved;
+  uint64 sector;
+};
+
 static struct disk {
  // memory for virtio descriptors &c for queue 0.
  // this is a global instead of allocated because it must
@@ -32,15 +43,33 @@ static struct disk {
 
   // our own book-keeping.
   char free[NUM];  // is a descriptor free?
+  int nfree;       // how many are free?
   uint16 used_idx; // we've looked this far in used[2..NUM].
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct buf *b;    // the request's bufs, chained by qnext
     char status;
   } info[NUM];
+  int inflight;       // requests the device has
+
+  // bufs submitted but not yet handed to the device, in
+  // order, chained by qnext. they wait here while the device
+  // is busy, so that adjacent blocks can be merged.
+  struct buf *queue;
+
+  // statistics, for virtio_disk_stat().
+  uint64 nreq;
+  uint64 nblock;
+  uint64 nwrite;
+  uint statstart;    // ticks when last reset
+
+  // request headers, indexed like info[]. they live here
+  // rather than on the caller's stack since a request
+  // started by virtio_disk_submit() outlives its call.
+  struct virtio_blk_outhdr ops[NUM];
   
   struct spinlock vdisk_lock;
   
@@ -99,7 +128,7 @@ virtio_disk_init(void)
   *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
 
   // desc = pages -- num * VRingDesc
-  // avail = pages + 0x40 -- 2 * uint16, then num * uint16
+  // avail = pages + num*16 -- 2 * uint16, then num * uint16
   // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
 
   disk.desc = (struct VRingDesc *) disk.pages;
@@ -108,6 +137,7 @@ virtio_disk_init(void)
 
   for(int i = 0; i < NUM; i++)
     disk.free[i] = 1;
+  disk.nfree = NUM;
 
   // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
 }
@@ -119,10 +149,11 @@ alloc_desc()
   for(int i = 0; i < NUM; i++){
     if(disk.free[i]){
       disk.free[i] = 0;
+      disk.nfree--;
       return i;
     }
   }
-  return -1;
+  panic("virtio_disk alloc_desc");
 }
 
 // mark a descriptor as free.
@@ -135,7 +166,7 @@ free_desc(int i)
     panic("virtio_disk_intr 2");
   disk.desc[i].addr = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
+  disk.nfree++;
 }
 
 // free a chain of descriptors.
@@ -151,106 +182,156 @@ free_chain(int i)
   }
 }
 
-static int
-alloc3_desc(int *idx)
-{
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
-    if(idx[i] < 0){
-      for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
-      return -1;
-    }
-  }
-  return 0;
-}
-
-void
-virtio_disk_rw(struct buf *b, int write)
+// hand the device one request for the n bufs chained from b,
+// which are for consecutive blocks. the spec says that legacy
+// block operations use a descriptor for type/reserved/sector,
+// then one per data buffer, then one for a 1-byte status
+// result. caller must hold vdisk_lock and have checked that
+// there are n+2 free descriptors.
+static void
+virtio_disk_start(struct buf *b, int n)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  struct buf *first = b;
+  int head, prev, i;
 
-  acquire(&disk.vdisk_lock);
-
-  // the spec says that legacy block operations use three
-  // descriptors: one for type/reserved/sector, one for
-  // the data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
-  
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_outhdr {
-    uint32 type;
-    uint32 reserved;
-    uint64 sector;
-  } buf0;
+  head = alloc_desc();
+  struct virtio_blk_outhdr *buf0 = &disk.ops[head];
 
-  if(write)
-    buf0.type = VIRTIO_BLK_T_OUT; // write the disk
+  if(b->iowrite)
+    buf0->type = VIRTIO_BLK_T_OUT; // write the disk
   else
-    buf0.type = VIRTIO_BLK_T_IN; // read the disk
-  buf0.reserved = 0;
-  buf0.sector = sector;
-
-  // buf0 is on a kernel stack, which is not direct mapped,
-  // thus the call to kvmpa().
-  disk.desc[idx[0]].addr = (uint64) kvmpa((uint64) &buf0);
-  disk.desc[idx[0]].len = sizeof(buf0);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
-
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+    buf0->type = VIRTIO_BLK_T_IN; // read the disk
+  buf0->reserved = 0;
+  buf0->sector = b->blockno * (BSIZE / 512);
+
+  disk.desc[head].addr = (uint64) buf0;
+  disk.desc[head].len = sizeof(*buf0);
+  disk.desc[head].flags = VRING_DESC_F_NEXT;
+
+  prev = head;
+  for(; b; b = b->qnext){
+    i = alloc_desc();
+    disk.desc[prev].next = i;
+    disk.desc[i].addr = (uint64) b->data;
+    disk.desc[i].len = BSIZE;
+    if(first->iowrite)
+      disk.desc[i].flags = 0; // device reads b->data
+    else
+      disk.desc[i].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[i].flags |= VRING_DESC_F_NEXT;
+    prev = i;
+  }
 
-  disk.info[idx[0]].status = 0;
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  i = alloc_desc();
+  disk.desc[prev].next = i;
+  disk.info[head].status = 0;
+  disk.desc[i].addr = (uint64) &disk.info[head].status;
+  disk.desc[i].len = 1;
+  disk.desc[i].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[i].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the bufs for virtio_disk_intr().
+  disk.info[head].b = first;
+  disk.inflight++;
+
+  disk.nreq++;
+  disk.nblock += n;
+  if(first->iowrite)
+    disk.nwrite++;
 
   // avail[0] is flags
   // avail[1] tells the device how far to look in avail[2...].
   // avail[2...] are desc[] indices the device should process.
   // we only tell device the first index in our chain of descriptors.
-  disk.avail[2 + (disk.avail[1] % NUM)] = idx[0];
+  disk.avail[2 + (disk.avail[1] % NUM)] = head;
   __sync_synchronize();
   disk.avail[1] = disk.avail[1] + 1;
+}
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+// hand the device as many queued bufs as there are
+// descriptors for, each merged with up to MAXSEG-1 others
+// queued for the blocks right after it.
+// caller must hold vdisk_lock.
+static void
+virtio_disk_dispatch(void)
+{
+  struct buf *b, *last, **pp;
+  int n, sent = 0;
+
+  while((b = disk.queue) != 0 && disk.nfree >= 3){
+    disk.queue = b->qnext;
+    b->qnext = 0;
+    last = b;
+    for(n = 1; n < MAXSEG && n + 3 <= disk.nfree; n++){
+      for(pp = &disk.queue; *pp; pp = &(*pp)->qnext){
+        if((*pp)->iowrite == b->iowrite && (*pp)->dev == b->dev &&
+           (*pp)->blockno == last->blockno + 1)
+          break;
+      }
+      if(*pp == 0)
+        break;
+      last->qnext = *pp;
+      last = *pp;
+      *pp = last->qnext;
+      last->qnext = 0;
+    }
+    virtio_disk_start(b, n);
+    sent = 1;
+  }
 
-  // Wait for virtio_disk_intr() to say request has finished.
+  if(sent)
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
+
+// start reading or writing b, and return without waiting
+// for the disk. when the disk is done, virtio_disk_intr()
+// clears b->disk and then calls b->iodone(b), if it is set,
+// or else wakes up virtio_disk_wait(). b must stay locked
+// until then.
+// b goes to the device at once if it is idle, and otherwise
+// waits in disk.queue to be merged with requests for
+// adjacent blocks.
+void
+virtio_disk_submit(struct buf *b, int write)
+{
+  struct buf **pp;
+
+  acquire(&disk.vdisk_lock);
+  b->disk = 1;
+  b->iowrite = write;
+  b->qnext = 0;
+  for(pp = &disk.queue; *pp; pp = &(*pp)->qnext)
+    ;
+  *pp = b;
+  if(disk.inflight == 0)
+    virtio_disk_dispatch();
+  release(&disk.vdisk_lock);
+}
+
+// wait for the request virtio_disk_submit() started on b,
+// which must have no iodone, to finish. returns at once if
+// there is none.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  // don't leave b queued while we sleep.
+  if(b->disk == 1)
+    virtio_disk_dispatch();
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
-
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
-
   release(&disk.vdisk_lock);
 }
 
 void
 virtio_disk_intr()
 {
+  struct buf *b, *next;
+
   acquire(&disk.vdisk_lock);
 
   while((disk.used_idx % NUM) != (disk.used->id % NUM)){
@@ -258,13 +339,52 @@ virtio_disk_intr()
 
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
-    
-    disk.info[id].b->disk = 0;   // disk is done with buf
-    wakeup(disk.info[id].b);
+
+    b = disk.info[id].b;
+    disk.info[id].b = 0;
+    free_chain(id);
+    disk.inflight--;
+
+    for(; b; b = next){
+      next = b->qnext;
+      b->qnext = 0;
+      b->disk = 0;   // disk is done with buf
+      if(b->iodone)
+        b->iodone(b);   // called holding vdisk_lock
+      else
+        wakeup(b);
+    }
 
     disk.used_idx = (disk.used_idx + 1) % NUM;
   }
+
+  // send whatever queued up while the device was busy.
+  virtio_disk_dispatch();
+
   *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
   release(&disk.vdisk_lock);
 }
+
+// Copy the request counts to user address addr, a struct
+// diskstat, and then clear them if reset is set.
+int
+virtio_disk_stat(uint64 addr, int reset)
+{
+  struct diskstat st;
+
+  memset(&st, 0, sizeof(st));
+  acquire(&disk.vdisk_lock);
+  st.nreq = disk.nreq;
+  st.nblock = disk.nblock;
+  st.nwrite = disk.nwrite;
+  st.ticks = ticks - disk.statstart;
+  if(reset){
+    disk.nreq = 0;
+    disk.nblock = 0;
+    disk.nwrite = 0;
+    disk.statstart = ticks;
+  }
+  release(&disk.vdisk_lock);
+  return either_copyout(1, addr, &st, sizeof(st));
+}
@@ -122,6 +122,52 @@ void kvmmap(uint64 va, uint64 pa, uint64 sz, int perm)
         panic("kvmmap");
 }
 
+// create the page-table pages for sz bytes of kernel
+// virtual addresses starting at va, without mapping
+// anything, so that later kvmmapstack() calls never
+// need to allocate them. only used when booting.
+void kvmreserve(uint64 va, uint64 sz)
+{
+    uint64 a;
+
+    for (a = PGROUNDDOWN(va); a < va + sz; a += PGSIZE)
+        if (walk(kernel_pagetable, a, 1) == 0)
+            panic("kvmreserve");
+}
+
+// allocate a page for a kernel stack and map it at va,
+// whose page-table pages kvmreserve() created.
+// returns 0 on success, -1 if out of memory.
+// does not flush TLB.
+int kvmmapstack(uint64 va)
+{
+    pte_t *pte;
+    char *mem;
+
+    if ((pte = walk(kernel_pagetable, va, 0)) == 0)
+        panic("kvmmapstack");
+    if (*pte & PTE_V)
+        panic("kvmmapstack: remap");
+    if ((mem = kalloc()) == 0)
+        return -1;
+    *pte = PA2PTE(mem) | PTE_R | PTE_W | PTE_V;
+    return 0;
+}
+
+// unmap the kernel stack at va, if any, and free its page.
+// does not flush TLB.
+void kvmunmapstack(uint64 va)
+{
+    pte_t *pte;
+
+    if ((pte = walk(kernel_pagetable, va, 0)) == 0)
+        panic("kvmunmapstack");
+    if ((*pte & PTE_V) == 0)
+        return;
+    kfree((void *)PTE2PA(*pte));
+    *pte = 0;
+}
+
 // translate a kernel virtual address to
 // a physical address. only needed for
 // addresses on the stack.
@@ -330,6 +376,15 @@ int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
         pa = PTE2PA(*pte);
         flags = PTE_FLAGS(*pte);
 
+        if (flags & PTE_SHARED)
+        {
+            // map the same physical page, still writable.
+            if (mappages(new, i, PGSIZE, pa, flags) != 0)
+                goto err;
+            increment_ref(pa);
+            continue;
+        }
+
         flags &= ~PTE_W;
         flags |= PTE_COW;
 
@@ -350,6 +405,47 @@ err:
     return -1;
 }
 
+// Mark npages of user memory starting at va as shared, so that
+// fork() maps them into the child instead of copying them.
+// Breaks any copy-on-write sharing first, so the pages are
+// private to this process until the next fork().
+// Returns 0 on success, -1 if a page isn't mapped or out of memory.
+int uvmshare(pagetable_t pagetable, uint64 va, uint64 npages)
+{
+    uint64 a;
+    pte_t *pte;
+
+    if ((va % PGSIZE) != 0)
+        return -1;
+
+    for (a = va; a < va + npages * PGSIZE; a += PGSIZE)
+    {
+        if (walkaddr(pagetable, a) == 0)
+            return -1;
+        if (handle_cow(pagetable, a) < 0)
+            return -1;
+        pte = walk(pagetable, a, 0);
+        *pte |= PTE_SHARED;
+    }
+    return 0;
+}
+
+// Look up a user virtual address that the caller intends
+// to write, breaking copy-on-write sharing first so that
+// the physical address stays the same from now on.
+// Returns the physical address of va, or 0 if not mapped.
+uint64
+walkaddrw(pagetable_t pagetable, uint64 va)
+{
+    uint64 va0 = PGROUNDDOWN(va);
+
+    if (walkaddr(pagetable, va0) == 0)
+        return 0;
+    if (handle_cow(pagetable, va0) < 0)
+        return 0;
+    return walkaddr(pagetable, va0) + (va - va0);
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void uvmclear(pagetable_t pagetable, uint64 va)
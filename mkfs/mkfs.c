@@ -67,7 +67,7 @@ xint(uint x)
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
+  int i, cc, fd, flags;
   uint rootino, inum, off;
   struct dirent de;
   char buf[BSIZE];
@@ -76,8 +76,28 @@ main(int argc, char *argv[])
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  flags = 0;
+  while(argc > 1 && argv[1][0] == '-'){
+    if(strcmp(argv[1], "-o") == 0){
+      // ordered journaling: see FS_ORDERED.
+      flags |= FS_ORDERED;
+    } else if(strcmp(argv[1], "-l") == 0 && argc > 2){
+      // log blocks, including its header blocks.
+      nlog = atoi(argv[2]);
+      if(nlog < MAXOPBLOCKS+1 || nlog > FSSIZE/2){
+        fprintf(stderr, "mkfs: bad log size %s\n", argv[2]);
+        exit(1);
+      }
+      argc--;
+      argv++;
+    } else
+      break;
+    argc--;
+    argv++;
+  }
+
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-o] [-l nlog] fs.img files...\n");
     exit(1);
   }
 
@@ -102,6 +122,7 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.flags = xint(flags);
 
   printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
          nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -238,6 +259,8 @@ ialloc(ushort type)
   din.type = xshort(type);
   din.nlink = xshort(1);
   din.size = xint(0);
+  if(type == T_FILE)
+    din.flags = xshort(DI_INLINE);
   winode(inum, &din);
   return inum;
 }
@@ -260,6 +283,46 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the block holding block fbn of the file din,
+// allocating it and the indirect blocks on the way if
+// needed, like bmap() in kernel/fs.c.
+uint
+fbmap(struct dinode *din, uint fbn)
+{
+  uint indirect[NINDIRECT];
+  uint addr, nmap;
+  int level;
+
+  if(fbn < NDIRECT){
+    if(xint(din->addrs[fbn]) == 0)
+      din->addrs[fbn] = xint(freeblock++);
+    return xint(din->addrs[fbn]);
+  }
+  fbn -= NDIRECT;
+
+  nmap = NINDIRECT;
+  for(level = 0; level < NLEVEL && fbn >= nmap; level++){
+    fbn -= nmap;
+    nmap *= NINDIRECT;
+  }
+  assert(level < NLEVEL);
+
+  if(xint(din->addrs[NDIRECT+level]) == 0)
+    din->addrs[NDIRECT+level] = xint(freeblock++);
+  addr = xint(din->addrs[NDIRECT+level]);
+  for(; level >= 0; level--){
+    nmap /= NINDIRECT;
+    rsect(addr, (char*)indirect);
+    if(indirect[fbn / nmap] == 0){
+      indirect[fbn / nmap] = xint(freeblock++);
+      wsect(addr, (char*)indirect);
+    }
+    addr = xint(indirect[fbn / nmap]);
+    fbn %= nmap;
+  }
+  return addr;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -267,31 +330,33 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
   off = xint(din.size);
   // printf("append inum %d at off %d sz %d\n", inum, off, n);
+  if(xshort(din.flags) & DI_INLINE){
+    if(off + n <= NINLINE){
+      bcopy(p, din.data + off, n);
+      din.size = xint(off + n);
+      winode(inum, &din);
+      return;
+    }
+    // too big to stay inline: start again with the data
+    // in blocks, like iexpand() in kernel/fs.c.
+    bcopy(din.data, buf, off);
+    bzero(din.data, sizeof(din.data));
+    din.flags = xshort(xshort(din.flags) & ~DI_INLINE);
+    din.size = xint(0);
+    winode(inum, &din);
+    iappend(inum, buf, off);
+    iappend(inum, p, n);
+    return;
+  }
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = fbmap(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
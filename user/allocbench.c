@@ -0,0 +1,94 @@
+//
+// block allocation benchmark.
+// NCHILD processes at once each write, and then remove, a
+// file of NBLOCKS blocks of its own, NROUND times, so they
+// allocate and free blocks and inodes concurrently, and
+// report the elapsed ticks. then one process reads a file
+// back, which is faster if its blocks are close together.
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NCHILD  4
+#define NROUND  5
+#define NBLOCKS 64
+
+char buf[1024];
+
+void
+mkname(char *name, int i)
+{
+  strcpy(name, "allocbench.0");
+  name[11] = '0' + i;
+}
+
+void
+writefile(char *name)
+{
+  int n, fd;
+
+  if((fd = open(name, O_CREATE|O_WRONLY)) < 0){
+    printf("allocbench: create %s failed\n", name);
+    exit(1);
+  }
+  for(n = 0; n < NBLOCKS; n++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("allocbench: write %s failed\n", name);
+      exit(1);
+    }
+  }
+  close(fd);
+}
+
+void
+writer(int i)
+{
+  int n;
+  char name[16];
+
+  mkname(name, i);
+  for(n = 0; n < NROUND; n++){
+    writefile(name);
+    unlink(name);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, fd, t0;
+
+  memset(buf, 'a', sizeof(buf));
+  t0 = uptime();
+  for(i = 0; i < NCHILD; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("allocbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      writer(i);
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++)
+    wait(0);
+  printf("%d procs x %d files of %d blocks: %d ticks\n",
+         NCHILD, NROUND, NBLOCKS, uptime() - t0);
+
+  writefile("allocbench.big");
+  t0 = uptime();
+  if((fd = open("allocbench.big", O_RDONLY)) < 0){
+    printf("allocbench: open allocbench.big failed\n");
+    exit(1);
+  }
+  while(read(fd, buf, sizeof(buf)) > 0)
+    ;
+  close(fd);
+  printf("read %d blocks: %d ticks\n", NBLOCKS, uptime() - t0);
+  unlink("allocbench.big");
+  printf("allocbench: ok\n");
+  exit(0);
+}
@@ -0,0 +1,154 @@
+//
+// buffer cache benchmark.
+// NCHILD processes at once each re-read a small file of
+// their own, so they mostly hit in the buffer cache on
+// different blocks, and report the elapsed ticks, the
+// cache hit rate, and contention on the cache's locks.
+// then one process re-reads a file bigger than NBUF blocks,
+// with the cache held to NBUF buffers and then allowed to
+// grow, and reports the hit rate of each.
+//
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/fcntl.h"
+#include "kernel/bcachestat.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+#define NCHILD  4
+#define NREAD   200
+#define NBLOCKS 4
+#define NSTAT   64
+#define NBIG    (NBUF*3)
+#define NPASS   5
+
+char buf[1024];
+struct lockstat ls[NSTAT];
+
+void
+mkname(char *name, int i)
+{
+  strcpy(name, "bcachebench.0");
+  name[12] = '0' + i;
+}
+
+void
+readall(char *name)
+{
+  int fd;
+
+  if((fd = open(name, O_RDONLY)) < 0){
+    printf("bcachebench: open %s failed\n", name);
+    exit(1);
+  }
+  while(read(fd, buf, sizeof(buf)) > 0)
+    ;
+  close(fd);
+}
+
+void
+reader(int i)
+{
+  int n;
+  char name[16];
+
+  mkname(name, i);
+  for(n = 0; n < NREAD; n++)
+    readall(name);
+}
+
+// re-read a file of NBIG blocks with the cache limited to
+// limit buffers.
+void
+big(int limit)
+{
+  int n;
+  struct bcachestat st;
+
+  if(bcachelimit(limit) < 0){
+    printf("bcachebench: bcachelimit %d failed\n", limit);
+    exit(1);
+  }
+  readall("bcachebench.big");
+  bcachestat(&st, 1);
+  for(n = 0; n < NPASS; n++)
+    readall("bcachebench.big");
+  bcachestat(&st, 0);
+  printf("%d blocks x %d reads, limit %d: %d bufs, %l%% hit rate\n",
+         NBIG, NPASS, st.limit, st.nbuf,
+         st.nhit * 100 / (st.nhit + st.nmiss + 1));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, fd, t0;
+  char name[16];
+  struct bcachestat st;
+
+  memset(buf, 'b', sizeof(buf));
+  for(i = 0; i < NCHILD; i++){
+    mkname(name, i);
+    if((fd = open(name, O_CREATE|O_WRONLY)) < 0){
+      printf("bcachebench: create %s failed\n", name);
+      exit(1);
+    }
+    for(n = 0; n < NBLOCKS; n++)
+      write(fd, buf, sizeof(buf));
+    close(fd);
+  }
+
+  bcachestat(&st, 1);
+  lockstat(ls, 0, 1);
+  t0 = uptime();
+  for(i = 0; i < NCHILD; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("bcachebench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      reader(i);
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++)
+    wait(0);
+  t0 = uptime() - t0;
+
+  if(bcachestat(&st, 0) < 0){
+    printf("bcachebench: bcachestat failed\n");
+    exit(1);
+  }
+  printf("%d procs x %d reads: %d ticks\n", NCHILD, NREAD, t0);
+  printf("%d bufs: %l hits, %l misses", st.nbuf, st.nhit, st.nmiss);
+  if(st.nhit + st.nmiss > 0)
+    printf(", %l%% hit rate", st.nhit * 100 / (st.nhit + st.nmiss));
+  printf("\n");
+
+  n = lockstat(ls, NSTAT, 0);
+  for(i = 0; i < n; i++){
+    if(strcmp(ls[i].name, "bcache") == 0 || strcmp(ls[i].name, "bcache.bucket") == 0)
+      printf("%s: %l acquires, %l contended, %l spins\n", ls[i].name,
+             ls[i].nacquire, ls[i].ncontended, ls[i].nspin);
+  }
+
+  for(i = 0; i < NCHILD; i++){
+    mkname(name, i);
+    unlink(name);
+  }
+
+  if((fd = open("bcachebench.big", O_CREATE|O_WRONLY)) < 0){
+    printf("bcachebench: create bcachebench.big failed\n");
+    exit(1);
+  }
+  for(n = 0; n < NBIG; n++)
+    write(fd, buf, sizeof(buf));
+  close(fd);
+  big(NBUF);
+  big(st.limit);
+  unlink("bcachebench.big");
+  printf("bcachebench: ok\n");
+  exit(0);
+}
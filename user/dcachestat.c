@@ -0,0 +1,61 @@
+//
+// print directory entry cache statistics.
+//   dcachestat          print the counters since the last reset
+//   dcachestat -r       reset the counters
+//   dcachestat cmd ...  reset, run cmd, and print its counters
+//
+
+#include "kernel/types.h"
+#include "kernel/dcachestat.h"
+#include "user/user.h"
+
+void
+print(void)
+{
+  struct dcachestat st;
+  uint64 n;
+
+  if(dcachestat(&st, 0) < 0){
+    printf("dcachestat: dcachestat failed\n");
+    exit(1);
+  }
+  n = st.nhit + st.nneg + st.nmiss;
+  printf("%d entries (%d negative)\n", st.nentry, st.nnegentry);
+  printf("%l lookups: %l hits, %l negative hits, %l misses\n",
+         n, st.nhit, st.nneg, st.nmiss);
+  if(n > 0)
+    printf("%l%% hit rate\n", (st.nhit + st.nneg) * 100 / n);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+  struct dcachestat st;
+
+  if(argc == 1){
+    print();
+    exit(0);
+  }
+
+  if(dcachestat(&st, 1) < 0){
+    printf("dcachestat: reset failed\n");
+    exit(1);
+  }
+  if(strcmp(argv[1], "-r") == 0)
+    exit(0);
+
+  pid = fork();
+  if(pid < 0){
+    printf("dcachestat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    printf("dcachestat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  print();
+  exit(0);
+}
@@ -0,0 +1,96 @@
+//
+// large directory benchmark.
+// for directories of 10, 100, 1000 and 10000 entries, makes
+// the entries as links to one file, looks each of them up
+// with stat(), and removes them, reporting the ticks each
+// phase takes. a directory that outgrows one block is indexed
+// by name hash, so the cost per entry should stay flat as the
+// directory grows. runs in lazy log mode, so as to time the
+// directory rather than the commits.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/logstat.h"
+#include "user/user.h"
+
+char name[32];
+
+void
+mkname(int i)
+{
+  char *p;
+
+  strcpy(name, "dirbench.d/x");
+  p = name + strlen(name);
+  *p++ = '0' + i / 10000 % 10;
+  *p++ = '0' + i / 1000 % 10;
+  *p++ = '0' + i / 100 % 10;
+  *p++ = '0' + i / 10 % 10;
+  *p++ = '0' + i % 10;
+  *p = 0;
+}
+
+void
+run(int n)
+{
+  int i, t0, t1, t2, t3;
+  struct stat st;
+
+  if(mkdir("dirbench.d") < 0){
+    printf("dirbench: mkdir failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    mkname(i);
+    if(link("dirbench.f", name) < 0){
+      printf("dirbench: link %s failed\n", name);
+      exit(1);
+    }
+  }
+  t1 = uptime();
+  for(i = 0; i < n; i++){
+    mkname(i);
+    if(stat(name, &st) < 0){
+      printf("dirbench: stat %s failed\n", name);
+      exit(1);
+    }
+  }
+  t2 = uptime();
+  for(i = 0; i < n; i++){
+    mkname(i);
+    if(unlink(name) < 0){
+      printf("dirbench: unlink %s failed\n", name);
+      exit(1);
+    }
+  }
+  t3 = uptime();
+  if(unlink("dirbench.d") < 0){
+    printf("dirbench: rmdir failed\n");
+    exit(1);
+  }
+  printf("%d entries: create %d ticks, lookup %d ticks, remove %d ticks\n",
+         n, t1 - t0, t2 - t1, t3 - t2);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, n, old;
+
+  if((fd = open("dirbench.f", O_CREATE|O_WRONLY)) < 0){
+    printf("dirbench: create failed\n");
+    exit(1);
+  }
+  close(fd);
+  old = logmode(0);
+  logmode(old | LOG_LAZY);
+  for(n = 10; n <= 10000; n *= 10)
+    run(n);
+  logmode(old);
+  unlink("dirbench.f");
+  printf("dirbench: ok\n");
+  exit(0);
+}
@@ -0,0 +1,61 @@
+//
+// print disk request statistics.
+//   diskstat          print the counters since the last reset
+//   diskstat -r       reset the counters
+//   diskstat cmd ...  reset, run cmd, and print its counters
+//
+
+#include "kernel/types.h"
+#include "kernel/diskstat.h"
+#include "user/user.h"
+
+void
+print(void)
+{
+  struct diskstat st;
+
+  if(diskstat(&st, 0) < 0){
+    printf("diskstat: diskstat failed\n");
+    exit(1);
+  }
+  printf("%l requests (%l writes), %l blocks in %d ticks\n",
+         st.nreq, st.nwrite, st.nblock, st.ticks);
+  if(st.nreq > 0)
+    printf("%l.%l blocks per request\n", st.nblock / st.nreq,
+           st.nblock * 10 / st.nreq % 10);
+  if(st.ticks > 0)
+    printf("%l requests per tick\n", st.nreq / st.ticks);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+  struct diskstat st;
+
+  if(argc == 1){
+    print();
+    exit(0);
+  }
+
+  if(diskstat(&st, 1) < 0){
+    printf("diskstat: reset failed\n");
+    exit(1);
+  }
+  if(strcmp(argv[1], "-r") == 0)
+    exit(0);
+
+  pid = fork();
+  if(pid < 0){
+    printf("diskstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    printf("diskstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  print();
+  exit(0);
+}
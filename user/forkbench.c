@@ -0,0 +1,75 @@
+//
+// fork/exit/wait throughput benchmark.
+// times NFORK fork+exit+wait cycles, first with an otherwise
+// idle process table and then with NIDLE sleeping processes,
+// and finally with children that themselves leave orphans
+// for init to reap.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define NFORK 2000
+#define NIDLE 40
+
+void
+cycles(char *name, int orphans)
+{
+  int i, pid, t0;
+
+  t0 = uptime();
+  for(i = 0; i < NFORK; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      if(orphans && fork() == 0)
+        exit(0);
+      exit(0);
+    }
+    if(wait(0) != pid){
+      printf("forkbench: wait returned the wrong pid\n");
+      exit(1);
+    }
+  }
+  printf("%s: %d fork/exit/wait: %d ticks\n", name, NFORK, uptime() - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, fds[2];
+  char c;
+
+  cycles("idle table", 0);
+
+  // park NIDLE children in read() on a pipe.
+  if(pipe(fds) < 0){
+    printf("forkbench: pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < NIDLE; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("forkbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[1]);
+      read(fds[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(fds[0]);
+
+  cycles("busy table", 0);
+  cycles("orphans", 1);
+
+  close(fds[1]);
+  for(i = 0; i < NIDLE; i++)
+    wait(0);
+  printf("forkbench: ok\n");
+  exit(0);
+}
@@ -2,10 +2,11 @@
 // Tiny executable so that the limit can be filling the proc table.
 
 #include "kernel/types.h"
+#include "kernel/param.h"
 #include "kernel/stat.h"
 #include "user/user.h"
 
-#define N  1000
+#define N  NPROC
 
 void
 print(const char *s)
@@ -0,0 +1,126 @@
+//
+// file system concurrency benchmark.
+// NCHILD processes at once, first all reading one shared
+// file, then each creating, writing and removing files of
+// its own in one shared directory, and finally all running
+// stat on one shared file. the shared inode, directory and
+// buffer locks are held briefly and contended heavily.
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define NREAD  200
+#define NFILE  40
+#define NSTAT  1000
+#define FILESZ 4096
+
+char buf[512];
+
+void
+readers(void)
+{
+  int i, n, fd;
+
+  for(i = 0; i < NREAD; i++){
+    if((fd = open("fsbench.shared", O_RDONLY)) < 0){
+      printf("fsbench: open failed\n");
+      exit(1);
+    }
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+      ;
+    close(fd);
+  }
+}
+
+void
+creators(int id)
+{
+  int i, fd;
+  char name[16];
+
+  strcpy(name, "fsbench.dir/f00");
+  for(i = 0; i < NFILE; i++){
+    name[13] = 'a' + id;
+    name[14] = '0' + i % 10;
+    if((fd = open(name, O_CREATE|O_WRONLY)) < 0){
+      printf("fsbench: create %s failed\n", name);
+      exit(1);
+    }
+    write(fd, buf, sizeof(buf));
+    close(fd);
+    unlink(name);
+  }
+}
+
+void
+staters(void)
+{
+  int i;
+  struct stat st;
+
+  for(i = 0; i < NSTAT; i++){
+    if(stat("fsbench.shared", &st) < 0){
+      printf("fsbench: stat failed\n");
+      exit(1);
+    }
+  }
+}
+
+void
+run(char *name, int phase)
+{
+  int n, t0;
+
+  t0 = uptime();
+  for(n = 0; n < NCHILD; n++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fsbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      if(phase == 0)
+        readers();
+      else if(phase == 1)
+        creators(n);
+      else
+        staters();
+      exit(0);
+    }
+  }
+  for(n = 0; n < NCHILD; n++)
+    wait(0);
+  printf("%s: %d procs: %d ticks\n", name, NCHILD, uptime() - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, fd;
+
+  if((fd = open("fsbench.shared", O_CREATE|O_WRONLY)) < 0){
+    printf("fsbench: create failed\n");
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < FILESZ; i += sizeof(buf))
+    write(fd, buf, sizeof(buf));
+  close(fd);
+  if(mkdir("fsbench.dir") < 0){
+    printf("fsbench: mkdir failed\n");
+    exit(1);
+  }
+
+  run("read shared file", 0);
+  run("create in shared dir", 1);
+  run("stat shared file", 2);
+
+  unlink("fsbench.dir");
+  unlink("fsbench.shared");
+  printf("fsbench: ok\n");
+  exit(0);
+}
@@ -0,0 +1,139 @@
+//
+// futex contention benchmark.
+// several processes increment a counter in a shared page under
+// a lock, first with a futex-based umutex and then with a plain
+// user-space spin lock, and report the elapsed ticks.
+// a condition-variable ping-pong checks ucond_wait/ucond_signal.
+//
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define NITER  5000
+#define NPING  1000
+
+struct shared {
+  struct umutex m;
+  struct ucond c;
+  volatile int spin;
+  volatile int counter;
+  volatile int turn;
+};
+
+struct shared *sh;
+
+// allocate one page, shared with the children we fork.
+struct shared*
+sharedpage(void)
+{
+  char *p = sbrk(2*PGSIZE);
+  if(p == (char*)-1){
+    printf("futexbench: sbrk failed\n");
+    exit(1);
+  }
+  p = (char*)PGROUNDUP((uint64)p);
+  if(mshare(p, PGSIZE) < 0){
+    printf("futexbench: mshare failed\n");
+    exit(1);
+  }
+  return (struct shared*)p;
+}
+
+void
+spinlock(void)
+{
+  while(__sync_lock_test_and_set(&sh->spin, 1) != 0)
+    ;
+  __sync_synchronize();
+}
+
+void
+spinunlock(void)
+{
+  __sync_synchronize();
+  __sync_lock_release(&sh->spin);
+}
+
+void
+contend(char *name, int usefutex)
+{
+  int i, n, t0;
+
+  sh->counter = 0;
+  t0 = uptime();
+  for(n = 0; n < NCHILD; n++){
+    int pid = fork();
+    if(pid < 0){
+      printf("futexbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      for(i = 0; i < NITER; i++){
+        if(usefutex)
+          umutex_lock(&sh->m);
+        else
+          spinlock();
+        sh->counter++;
+        if(usefutex)
+          umutex_unlock(&sh->m);
+        else
+          spinunlock();
+      }
+      exit(0);
+    }
+  }
+  for(n = 0; n < NCHILD; n++)
+    wait(0);
+
+  if(sh->counter != NCHILD*NITER){
+    printf("futexbench: %s: counter %d, expected %d\n", name,
+           sh->counter, NCHILD*NITER);
+    exit(1);
+  }
+  printf("%s: %d procs x %d iters: %d ticks\n", name, NCHILD, NITER,
+         uptime() - t0);
+}
+
+// two processes take turns, waking each other with the condvar.
+void
+pingpong(void)
+{
+  int i, t0, pid;
+
+  sh->turn = 0;
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    printf("futexbench: fork failed\n");
+    exit(1);
+  }
+  for(i = 0; i < NPING; i++){
+    umutex_lock(&sh->m);
+    while(sh->turn != (pid == 0))
+      ucond_wait(&sh->c, &sh->m);
+    sh->turn = !sh->turn;
+    ucond_signal(&sh->c);
+    umutex_unlock(&sh->m);
+  }
+  if(pid == 0)
+    exit(0);
+  wait(0);
+  printf("condvar: %d round trips: %d ticks\n", NPING, uptime() - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  sh = sharedpage();
+  umutex_init(&sh->m);
+  ucond_init(&sh->c);
+  sh->spin = 0;
+
+  contend("umutex", 1);
+  contend("spin", 0);
+  pingpong();
+  printf("futexbench: ok\n");
+  exit(0);
+}
@@ -0,0 +1,89 @@
+//
+// concurrent read/exec benchmark.
+// NCHILD processes at once repeatedly read this program's
+// binary, like concurrent cats, and then repeatedly exec
+// it, which walks "/" and reads the same inode, and report
+// the elapsed ticks. readers of one inode share its lock.
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define NCAT   20
+#define NEXEC  20
+
+char buf[1024];
+
+void
+cat(char *path)
+{
+  int i, fd;
+
+  for(i = 0; i < NCAT; i++){
+    if((fd = open(path, O_RDONLY)) < 0){
+      printf("ilockbench: open %s failed\n", path);
+      exit(1);
+    }
+    while(read(fd, buf, sizeof(buf)) > 0)
+      ;
+    close(fd);
+  }
+}
+
+void
+execs(char *path)
+{
+  int i, pid;
+  char *argv[] = { path, "-x", 0 };
+
+  for(i = 0; i < NEXEC; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("ilockbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(path, argv);
+      printf("ilockbench: exec %s failed\n", path);
+      exit(1);
+    }
+    wait(0);
+  }
+}
+
+void
+run(char *name, char *path, void (*f)(char*))
+{
+  int n, t0;
+
+  t0 = uptime();
+  for(n = 0; n < NCHILD; n++){
+    int pid = fork();
+    if(pid < 0){
+      printf("ilockbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      f(path);
+      exit(0);
+    }
+  }
+  for(n = 0; n < NCHILD; n++)
+    wait(0);
+  printf("%s: %d procs: %d ticks\n", name, NCHILD, uptime() - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  // exec'd by execs(): do nothing.
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit(0);
+
+  run("cat", "/ilockbench", cat);
+  run("exec", "/ilockbench", execs);
+  printf("ilockbench: ok\n");
+  exit(0);
+}
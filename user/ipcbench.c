@@ -0,0 +1,68 @@
+//
+// pipe round-trip latency benchmark.
+// a parent and child bounce a byte back and forth over two
+// pipes, first with both pinned to one CPU and then free to
+// run anywhere, and report the elapsed ticks.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define NROUND 10000
+
+void
+pingpong(char *name, int mask)
+{
+  int i, pid, t0;
+  int ping[2], pong[2];
+  char c = 0;
+
+  if(setaffinity(mask) < 0){
+    printf("ipcbench: setaffinity failed\n");
+    exit(1);
+  }
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("ipcbench: pipe failed\n");
+    exit(1);
+  }
+
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    printf("ipcbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    for(i = 0; i < NROUND; i++){
+      if(read(ping[0], &c, 1) != 1 || write(pong[1], &c, 1) != 1){
+        printf("ipcbench: child read/write failed\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+
+  close(ping[0]);
+  close(pong[1]);
+  for(i = 0; i < NROUND; i++){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf("ipcbench: parent read/write failed\n");
+      exit(1);
+    }
+  }
+  wait(0);
+  printf("%s: %d round trips: %d ticks\n", name, NROUND, uptime() - t0);
+  close(ping[1]);
+  close(pong[0]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  pingpong("one cpu", 1);
+  pingpong("any cpu", -1);
+  printf("ipcbench: ok\n");
+  exit(0);
+}
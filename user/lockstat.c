@@ -0,0 +1,76 @@
+//
+// print spinlock contention statistics.
+//   lockstat          print the counters since the last reset
+//   lockstat -r       reset the counters
+//   lockstat cmd ...  reset, run cmd, and print its counters
+//
+
+#include "kernel/types.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+#define NSTAT 64
+
+struct lockstat st[NSTAT];
+
+void
+print(void)
+{
+  int i, j, n;
+  struct lockstat t;
+
+  if((n = lockstat(st, NSTAT, 0)) < 0){
+    printf("lockstat: lockstat failed\n");
+    exit(1);
+  }
+
+  // most contended first.
+  for(i = 1; i < n; i++){
+    t = st[i];
+    for(j = i; j > 0 && st[j-1].ncontended < t.ncontended; j--)
+      st[j] = st[j-1];
+    st[j] = t;
+  }
+
+  printf("lock            acquire    contended  spins\n");
+  for(i = 0; i < n; i++){
+    if(st[i].nacquire == 0)
+      continue;
+    printf("%s", st[i].name);
+    for(j = strlen(st[i].name); j < 16; j++)
+      printf(" ");
+    printf("%l %l %l\n", st[i].nacquire, st[i].ncontended, st[i].nspin);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+
+  if(argc == 1){
+    print();
+    exit(0);
+  }
+
+  if(lockstat(st, 0, 1) < 0){
+    printf("lockstat: reset failed\n");
+    exit(1);
+  }
+  if(strcmp(argv[1], "-r") == 0)
+    exit(0);
+
+  pid = fork();
+  if(pid < 0){
+    printf("lockstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    printf("lockstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  print();
+  exit(0);
+}
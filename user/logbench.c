@@ -0,0 +1,101 @@
+//
+// small synchronous write benchmark.
+// each write() to a file is a transaction that returns only
+// once it has committed to disk, like a write and fsync.
+// NCHILD processes at once each append small records to a
+// file of their own, first one process alone and then all of
+// them, and report write()s per tick and disk requests per
+// write(). transactions that end while a commit is running
+// are committed together by the next one.
+// then the same again in lazy log mode, where only each
+// process's final fsync() waits for the disk.
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/diskstat.h"
+#include "kernel/logstat.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define NWRITE 100
+
+char buf[64];
+
+void
+writer(int i)
+{
+  int n, fd;
+  char name[16];
+
+  strcpy(name, "logbench.0");
+  name[9] = '0' + i;
+  if((fd = open(name, O_CREATE|O_WRONLY)) < 0){
+    printf("logbench: create %s failed\n", name);
+    exit(1);
+  }
+  for(n = 0; n < NWRITE; n++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("logbench: write failed\n");
+      exit(1);
+    }
+  }
+  if(fsync(fd) < 0){
+    printf("logbench: fsync failed\n");
+    exit(1);
+  }
+  close(fd);
+  unlink(name);
+}
+
+void
+run(char *mode, int nproc)
+{
+  int i, t;
+  uint64 n;
+  struct diskstat st;
+
+  diskstat(&st, 1);
+  t = uptime();
+  for(i = 0; i < nproc; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("logbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      writer(i);
+      exit(0);
+    }
+  }
+  for(i = 0; i < nproc; i++)
+    wait(0);
+  t = uptime() - t;
+  diskstat(&st, 0);
+
+  printf("%s, %d procs: %d writes in %d ticks", mode, nproc, nproc * NWRITE, t);
+  if(t > 0)
+    printf(", %d writes/tick", nproc * NWRITE / t);
+  n = st.nreq * 10 / (nproc * NWRITE);
+  printf(", %l.%l disk requests/write\n", n / 10, n % 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int old;
+
+  memset(buf, 'l', sizeof(buf));
+  if((old = logmode(0)) < 0){
+    printf("logbench: logmode failed\n");
+    exit(1);
+  }
+  run("sync", 1);
+  run("sync", NCHILD);
+  logmode(LOG_LAZY);
+  run("lazy", 1);
+  run("lazy", NCHILD);
+  logmode(old);
+  printf("logbench: ok\n");
+  exit(0);
+}
@@ -0,0 +1,83 @@
+//
+// large write benchmark for different log sizes.
+// writes a file of NBLOCK blocks in big write()s with the
+// log limited to each of 30, 64, ... 1024 blocks in turn, or
+// as many as the on-disk log has, and reports kilobytes per
+// tick and transactions per write(). a write() is split into
+// transactions of at most a third of the log each.
+// make the file system with MKFSFLAGS="-l 1030" to try the
+// bigger sizes.
+//
+
+#include "kernel/types.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+#include "kernel/logstat.h"
+#include "user/user.h"
+
+#define NBLOCK 256
+#define WRSIZE (64*BSIZE)
+
+char buf[WRSIZE];
+
+void
+run(int size)
+{
+  int i, fd, t;
+  uint64 n;
+  struct logstat st;
+
+  if(logsize(size) < 0){
+    printf("logsizebench: logsize %d failed\n", size);
+    exit(1);
+  }
+  if((fd = open("logsizebench.tmp", O_CREATE|O_WRONLY)) < 0){
+    printf("logsizebench: create failed\n");
+    exit(1);
+  }
+  logstat(&st, 1);
+  t = uptime();
+  for(i = 0; i < NBLOCK*BSIZE; i += WRSIZE){
+    if(write(fd, buf, WRSIZE) != WRSIZE){
+      printf("logsizebench: write failed\n");
+      exit(1);
+    }
+  }
+  t = uptime() - t;
+  logstat(&st, 0);
+  close(fd);
+  unlink("logsizebench.tmp");
+
+  printf("log %d blocks: %d KB in %d ticks", size, NBLOCK*BSIZE/1024, t);
+  if(t > 0)
+    printf(", %d KB/tick", NBLOCK*BSIZE/1024 / t);
+  n = st.ncommit * 10 / (NBLOCK*BSIZE / WRSIZE);
+  printf(", %l.%l commits/write\n", n / 10, n % 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int size, max;
+
+  memset(buf, 's', sizeof(buf));
+  // the log starts out using all of its on-disk blocks.
+  if((max = logsize(0)) < 0){
+    printf("logsizebench: logsize failed\n");
+    exit(1);
+  }
+  for(size = 30; ; size *= 2){
+    if(size > 1024)
+      size = 1024;
+    if(size > max)
+      size = max;
+    run(size);
+    if(size == max || size == 1024)
+      break;
+    if(size == 30)
+      size = 32;
+  }
+  logsize(max);
+  printf("logsizebench: ok\n");
+  exit(0);
+}
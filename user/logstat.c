@@ -0,0 +1,68 @@
+//
+// print log commit statistics and a histogram of commit
+// latencies.
+//   logstat          print the counters since the last reset
+//   logstat -r       reset the counters
+//   logstat cmd ...  reset, run cmd, and print its counters
+//
+
+#include "kernel/types.h"
+#include "kernel/logstat.h"
+#include "user/user.h"
+
+void
+print(void)
+{
+  int i;
+  struct logstat st;
+
+  if(logstat(&st, 0) < 0){
+    printf("logstat: logstat failed\n");
+    exit(1);
+  }
+  printf("%l commits, %l ops, %l blocks\n", st.ncommit, st.nop, st.nblock);
+  if(st.ncommit == 0)
+    return;
+  printf("commit latency (us):\n");
+  for(i = 0; i < NLOGHIST; i++){
+    if(st.hist[i] == 0)
+      continue;
+    if(i == NLOGHIST-1)
+      printf("  >= %d: %l\n", 1 << i, st.hist[i]);
+    else
+      printf("  < %d: %l\n", 1 << (i+1), st.hist[i]);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+  struct logstat st;
+
+  if(argc == 1){
+    print();
+    exit(0);
+  }
+
+  if(logstat(&st, 1) < 0){
+    printf("logstat: reset failed\n");
+    exit(1);
+  }
+  if(strcmp(argv[1], "-r") == 0)
+    exit(0);
+
+  pid = fork();
+  if(pid < 0){
+    printf("logstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    printf("logstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  print();
+  exit(0);
+}
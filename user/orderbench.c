@@ -0,0 +1,73 @@
+//
+// bulk write benchmark for the two journaling modes.
+// writes a file of NBLOCK blocks, NPASS times, first logging
+// every block and then logging only metadata (ordered mode,
+// where file data goes straight to its home location), and
+// reports the throughput and disk blocks written per file
+// block of each.
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/diskstat.h"
+#include "kernel/logstat.h"
+#include "user/user.h"
+
+#define NBLOCK 200
+#define NPASS  4
+
+char buf[8*1024];
+
+void
+run(char *name, int mode)
+{
+  int i, n, fd, t;
+  uint64 x;
+  struct diskstat st;
+
+  if(logmode(mode) < 0){
+    printf("orderbench: logmode failed\n");
+    exit(1);
+  }
+  diskstat(&st, 1);
+  t = uptime();
+  for(i = 0; i < NPASS; i++){
+    if((fd = open("orderbench.file", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+      printf("orderbench: create failed\n");
+      exit(1);
+    }
+    for(n = 0; n < NBLOCK * 1024; n += sizeof(buf)){
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+        printf("orderbench: write failed\n");
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+  t = uptime() - t;
+  diskstat(&st, 0);
+
+  printf("%s: %d KB in %d ticks", name, NPASS * NBLOCK, t);
+  if(t > 0)
+    printf(", %d KB/tick", NPASS * NBLOCK / t);
+  x = st.nblock * 10 / (NPASS * NBLOCK);
+  printf(", %l.%l disk blocks per block written\n", x / 10, x % 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int old;
+
+  memset(buf, 'o', sizeof(buf));
+  if((old = logmode(0)) < 0){
+    printf("orderbench: logmode failed\n");
+    exit(1);
+  }
+  run("journal", 0);
+  run("ordered", LOG_ORDERED);
+  logmode(old);
+  unlink("orderbench.file");
+  printf("orderbench: ok\n");
+  exit(0);
+}
@@ -0,0 +1,99 @@
+//
+// sequential read benchmark.
+// writes a file of NBLOCK blocks, then reads it through
+// start to finish NPASS times, first from disk (having
+// emptied the buffer cache by shrinking it to NBUF buffers)
+// and then from the cache, and reports the throughput of
+// each. read-ahead should bring the first close to the
+// second.
+//
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/fcntl.h"
+#include "kernel/bcachestat.h"
+#include "user/user.h"
+
+#define NBLOCK 200
+#define NPASS  4
+
+char buf[1024];
+
+// read the file through, returning the ticks taken.
+int
+readall(void)
+{
+  int fd, n, t0;
+
+  t0 = uptime();
+  if((fd = open("rabench.file", O_RDONLY)) < 0){
+    printf("rabench: open failed\n");
+    exit(1);
+  }
+  n = 0;
+  while(read(fd, buf, sizeof(buf)) == sizeof(buf))
+    n++;
+  close(fd);
+  if(n != NBLOCK){
+    printf("rabench: read %d blocks, not %d\n", n, NBLOCK);
+    exit(1);
+  }
+  return uptime() - t0;
+}
+
+void
+report(char *name, int ticks, struct bcachestat *st)
+{
+  printf("%s: %d KB in %d ticks", name, NPASS * NBLOCK, ticks);
+  if(ticks > 0)
+    printf(", %d KB/tick", NPASS * NBLOCK / ticks);
+  printf("; %l misses, %l read ahead\n", st->nmiss, st->nprefetch);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, fd, ticks;
+  struct bcachestat st;
+
+  if(bcachestat(&st, 0) < 0){
+    printf("rabench: bcachestat failed\n");
+    exit(1);
+  }
+  if(st.limit < NBLOCK + NBUF)
+    printf("rabench: cache limit %d is smaller than the file\n", st.limit);
+
+  if((fd = open("rabench.file", O_CREATE|O_WRONLY)) < 0){
+    printf("rabench: create failed\n");
+    exit(1);
+  }
+  memset(buf, 'r', sizeof(buf));
+  for(i = 0; i < NBLOCK; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("rabench: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  ticks = 0;
+  bcachestat(&st, 1);
+  for(i = 0; i < NPASS; i++){
+    bcachelimit(NBUF);
+    bcachelimit(st.limit);
+    ticks += readall();
+  }
+  bcachestat(&st, 0);
+  report("cold", ticks, &st);
+
+  ticks = 0;
+  bcachestat(&st, 1);
+  for(i = 0; i < NPASS; i++)
+    ticks += readall();
+  bcachestat(&st, 0);
+  report("warm", ticks, &st);
+
+  unlink("rabench.file");
+  printf("rabench: ok\n");
+  exit(0);
+}
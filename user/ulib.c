@@ -134,3 +134,69 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// Mutex on top of futex_wait/futex_wake: uncontended lock and
+// unlock are a single atomic instruction; only contended
+// operations enter the kernel.
+
+void
+umutex_init(struct umutex *m)
+{
+  m->state = 0;
+}
+
+void
+umutex_lock(struct umutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  // announce a waiter, then sleep until the holder unlocks.
+  if(c != 2)
+    c = __sync_lock_test_and_set(&m->state, 2);
+  while(c != 0){
+    futex_wait(&m->state, 2);
+    c = __sync_lock_test_and_set(&m->state, 2);
+  }
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    // there may be waiters.
+    __sync_lock_release(&m->state);
+    futex_wake(&m->state, 1);
+  }
+}
+
+void
+ucond_init(struct ucond *c)
+{
+  c->seq = 0;
+}
+
+void
+ucond_wait(struct ucond *c, struct umutex *m)
+{
+  int seq = c->seq;
+
+  umutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  umutex_lock(m);
+}
+
+void
+ucond_signal(struct ucond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+ucond_broadcast(struct ucond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 0x7fffffff);
+}
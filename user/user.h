@@ -1,5 +1,21 @@
 struct stat;
 struct rtcdate;
+struct schedstat;
+struct lockstat;
+struct bcachestat;
+struct diskstat;
+struct logstat;
+struct dcachestat;
+
+// futex-based locks; must live in memory shared with mshare()
+// to synchronize more than one process.
+struct umutex {
+  volatile int state;  // 0 unlocked, 1 locked, 2 locked with waiters
+};
+
+struct ucond {
+  volatile int seq;    // bumped by every signal/broadcast
+};
 
 // system calls
 int fork(void);
@@ -23,6 +39,20 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int futex_wait(volatile int*, int);
+int futex_wake(volatile int*, int);
+int mshare(void*, int);
+int setaffinity(int);
+int schedstat(int, struct schedstat*);
+int lockstat(struct lockstat*, int, int);
+int bcachestat(struct bcachestat*, int);
+int bcachelimit(int);
+int diskstat(struct diskstat*, int);
+int logstat(struct logstat*, int);
+int logmode(int);
+int fsync(int);
+int logsize(int);
+int dcachestat(struct dcachestat*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -40,3 +70,10 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+void umutex_init(struct umutex*);
+void umutex_lock(struct umutex*);
+void umutex_unlock(struct umutex*);
+void ucond_init(struct ucond*);
+void ucond_wait(struct ucond*, struct umutex*);
+void ucond_signal(struct ucond*);
+void ucond_broadcast(struct ucond*);
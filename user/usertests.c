@@ -7,6 +7,7 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/sched.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -570,6 +571,61 @@ writetest(char *s)
   }
 }
 
+// a file stays in its inode up to NINLINE bytes, then moves
+// to blocks as it grows, and back when truncated.
+void
+inlinefile(char *s)
+{
+  int fd, i, n;
+  char c;
+
+  unlink("inlinefile");
+  fd = open("inlinefile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create inlinefile failed\n", s);
+    exit(1);
+  }
+  // one byte at a time, across NINLINE and the first block.
+  for(i = 0; i < BSIZE + NINLINE; i++){
+    c = 'a' + i % 26;
+    if(write(fd, &c, 1) != 1){
+      printf("%s: write %d failed\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  fd = open("inlinefile", O_RDONLY);
+  for(i = 0; (n = read(fd, &c, 1)) == 1; i++){
+    if(c != 'a' + i % 26){
+      printf("%s: byte %d is %c\n", s, i, c);
+      exit(1);
+    }
+  }
+  close(fd);
+  if(i != BSIZE + NINLINE){
+    printf("%s: read %d bytes, wanted %d\n", s, i, BSIZE + NINLINE);
+    exit(1);
+  }
+
+  fd = open("inlinefile", O_RDWR|O_TRUNC);
+  if(write(fd, "inline", 6) != 6 || read(fd, buf, sizeof(buf)) != 0){
+    printf("%s: write after truncate failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("inlinefile", O_RDONLY);
+  if(read(fd, buf, sizeof(buf)) != 6 || memcmp(buf, "inline", 6) != 0){
+    printf("%s: read after truncate failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("inlinefile");
+}
+
+// blocks in writebig()'s file: into the double indirect ones.
+#define NBIG (NDIRECT + 2*NINDIRECT)
+
 void
 writebig(char *s)
 {
@@ -581,7 +637,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < NBIG; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -601,7 +657,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != NBIG){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -724,6 +780,43 @@ exectest(char *s)
 
 }
 
+// a child blocks writing to a pipe, handing the CPU to its
+// parent, which may by then be running in wait(), holding
+// its own lock and waiting for the child's.
+void
+pipewait(char *s)
+{
+  int i, pid, xstatus, fds[2];
+  char c;
+
+  for(i = 0; i < 100; i++){
+    if(pipe(fds) != 0){
+      printf("%s: pipe() failed\n", s);
+      exit(1);
+    }
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork() failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      // more than the pipe holds, so the write sleeps.
+      write(fds[1], buf, sizeof(buf));
+      exit(0);
+    }
+    close(fds[1]);
+    if(read(fds[0], &c, 1) != 1){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    close(fds[0]);
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+}
+
 // simple fork and pipe read/write
 
 void
@@ -1962,7 +2055,7 @@ iref(char *s)
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = NPROC };
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -1979,7 +2072,7 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work %d times!\n", s, N);
     exit(1);
   }
 
@@ -2570,6 +2663,35 @@ execout(char *s)
   exit(0);
 }
 
+// a process pinned to CPU 0 must only run there, and
+// setaffinity() must reject masks with no running CPU.
+void
+affinity(char *s)
+{
+  struct schedstat st;
+
+  if(setaffinity(0) != -1){
+    printf("%s: setaffinity(0) succeeded\n", s);
+    exit(1);
+  }
+  if(setaffinity(1) < 0){
+    printf("%s: setaffinity(1) failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 10; i++){
+    sleep(1);
+    if(schedstat(0, &st) < 0){
+      printf("%s: schedstat failed\n", s);
+      exit(1);
+    }
+    if(st.affinity != 1 || st.lastcpu != 0){
+      printf("%s: ran on cpu %d with affinity %x\n", s, st.lastcpu, st.affinity);
+      exit(1);
+    }
+  }
+  exit(0);
+}
+
 //
 // use sbrk() to count how many free physical memory pages there are.
 // touches the pages to force allocation.
@@ -2725,12 +2847,14 @@ main(int argc, char *argv[])
     {opentest, "opentest"},
     {writetest, "writetest"},
     {writebig, "writebig"},
+    {inlinefile, "inlinefile"},
     {createtest, "createtest"},
     {openiputtest, "openiput"},
     {exitiputtest, "exitiput"},
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {pipewait, "pipewait"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
@@ -2739,6 +2863,7 @@ main(int argc, char *argv[])
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
+    {affinity, "affinity"},
     {bigdir, "bigdir"}, // slow
     { 0, 0},
   };
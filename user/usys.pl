@@ -36,3 +36,17 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("futex_wait");
+entry("futex_wake");
+entry("mshare");
+entry("setaffinity");
+entry("schedstat");
+entry("lockstat");
+entry("bcachestat");
+entry("bcachelimit");
+entry("diskstat");
+entry("logstat");
+entry("logmode");
+entry("fsync");
+entry("logsize");
+entry("dcachestat");